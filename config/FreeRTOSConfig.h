@@ -95,9 +95,12 @@
 #define configUSE_TICKLESS_IDLE                     1
 #define configCPU_CLOCK_HZ                          ( SystemCoreClock )
 #define configTICK_RATE_HZ                          1000
-#define configMAX_PRIORITIES                        ( 3 )
+#define configMAX_PRIORITIES                        ( 5 )
 #define configMINIMAL_STACK_SIZE                    ( 60 )
+/* Tests that start many threads raise the heap from the Makefile */
+#ifndef configTOTAL_HEAP_SIZE
 #define configTOTAL_HEAP_SIZE                       ( 4096 )
+#endif
 #define configMAX_TASK_NAME_LEN                     ( 4 )
 #define configUSE_16_BIT_TICKS                      0
 #define configIDLE_SHOULD_YIELD                     1
@@ -106,6 +109,7 @@
 #define configUSE_COUNTING_SEMAPHORES               1
 #define configUSE_ALTERNATIVE_API                   0    /* Deprecated! */
 #define configQUEUE_REGISTRY_SIZE                   2
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS     4
 #define configUSE_QUEUE_SETS                        0
 #define configUSE_TIME_SLICING                      0
 #define configUSE_NEWLIB_REENTRANT                  0
@@ -117,18 +121,41 @@
 #define configCHECK_FOR_STACK_OVERFLOW              0
 #define configUSE_MALLOC_FAILED_HOOK                0
 
+/* Memory allocation related definitions. */
+#define configSUPPORT_STATIC_ALLOCATION             1
+#define configSUPPORT_DYNAMIC_ALLOCATION            1
+
 /* Run time and task stats gathering related definitions. */
 #define configGENERATE_RUN_TIME_STATS               0
-#define configUSE_TRACE_FACILITY                    0
+/* Needed by xEventGroupSetBitsFromISR and vTaskGetInfo (ceiling mutexes) */
+#define configUSE_TRACE_FACILITY                    1
 #define configUSE_STATS_FORMATTING_FUNCTIONS        0
 
+/* Per thread statistics of the OS abstraction layer. The trace hooks keep
+ the run time of each thread in the thread handle, which is stored as the
+ application task tag. */
+#ifndef OS_THREAD_STATS
+#define OS_THREAD_STATS                             0
+#endif
+/* Mutex contention profiling of the OS abstraction layer, see
+ os_mutexGetStats. */
+#ifndef OS_MUTEX_PROFILE
+#define OS_MUTEX_PROFILE                            0
+#endif
+
+#if OS_THREAD_STATS
+#define configUSE_APPLICATION_TASK_TAG              1
+#define traceTASK_SWITCHED_IN()                     os_threadStatsSwitchedIn((void *)pxCurrentTCB->pxTaskTag)
+#define traceTASK_SWITCHED_OUT()                    os_threadStatsSwitchedOut((void *)pxCurrentTCB->pxTaskTag)
+#endif
+
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES                       0
 #define configMAX_CO_ROUTINE_PRIORITIES             ( 2 )
 
 /* Software timer definitions. */
 #define configUSE_TIMERS                            1
-#define configTIMER_TASK_PRIORITY                   ( 2 )
+#define configTIMER_TASK_PRIORITY                   ( configMAX_PRIORITIES - 1 )
 #define configTIMER_QUEUE_LENGTH                    32
 #define configTIMER_TASK_STACK_DEPTH                ( 80 )
 
@@ -224,6 +251,11 @@
 #include <stdint.h>
 extern uint32_t SystemCoreClock;
 #endif
+
+#if OS_THREAD_STATS
+void os_threadStatsSwitchedIn(void *tag);
+void os_threadStatsSwitchedOut(void *tag);
+#endif
 #endif /* !assembler */
 
 #endif /* FREERTOS_CONFIG_H */
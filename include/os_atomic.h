@@ -0,0 +1,251 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_atomic Atomic operations
+ * @{
+ * @ingroup os
+ *
+ * @brief Lock-free operations on 8, 16 and 32 bit values
+ *
+ * @details Use these for counters and flags that are shared between threads
+ * and ISRs instead of an os_mutex or os_sem. On Cortex-M4 the operations use
+ * the exclusive access instructions, an ISR that touches the value between
+ * the load and the store makes the store fail and the operation retry.
+ * Other builds, like a host build, use C11 atomics.
+ *
+ * Values must be declared with the os_atomic types and only be accessed
+ * through these functions. Every operation takes a memory order with the
+ * same meaning as in C11.
+ */
+
+#ifndef OS_ATOMIC_H
+#define OS_ATOMIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_7M__)
+#define OS_ATOMIC_EXCLUSIVE 1
+#include "nrf.h"
+#else
+#define OS_ATOMIC_EXCLUSIVE 0
+#include <stdatomic.h>
+#endif
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#if OS_ATOMIC_EXCLUSIVE
+typedef enum {
+    OS_ATOMIC_RELAXED,
+    OS_ATOMIC_ACQUIRE,
+    OS_ATOMIC_RELEASE,
+    OS_ATOMIC_ACQ_REL,
+    OS_ATOMIC_SEQ_CST
+} os_atomicOrder_t;
+
+typedef volatile uint8_t os_atomic8_t;
+typedef volatile uint16_t os_atomic16_t;
+typedef volatile uint32_t os_atomic32_t;
+
+static inline void os_atomicFenceBefore(os_atomicOrder_t order)
+{
+    if(order >= OS_ATOMIC_RELEASE)
+        __DMB();
+}
+
+static inline void os_atomicFenceAfter(os_atomicOrder_t order)
+{
+    if(order != OS_ATOMIC_RELAXED && order != OS_ATOMIC_RELEASE)
+        __DMB();
+}
+
+/*
+ * Read-modify-write loop on the exclusive monitor. The store fails when
+ * anything, like an interrupt, happened since the load.
+ */
+#define OS_ATOMIC_RMW(type, ldrex, strex, ptr, order, newValue)             \
+    type old;                                                               \
+    os_atomicFenceBefore(order);                                            \
+    do {                                                                    \
+        old = ldrex(ptr);                                                   \
+    } while(strex(newValue, ptr));                                          \
+    os_atomicFenceAfter(order);                                             \
+    return old
+
+#define OS_ATOMIC_DEFINE(bits, type, ldrex, strex)                          \
+static inline type os_atomicLoad##bits(os_atomic##bits##_t *ptr,           \
+        os_atomicOrder_t order)                                             \
+{                                                                           \
+    type value = *ptr;                                                      \
+    os_atomicFenceAfter(order);                                             \
+    return value;                                                           \
+}                                                                           \
+                                                                            \
+static inline void os_atomicStore##bits(os_atomic##bits##_t *ptr,          \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    os_atomicFenceBefore(order);                                            \
+    *ptr = value;                                                           \
+    if(order == OS_ATOMIC_SEQ_CST)                                          \
+        __DMB();                                                            \
+}                                                                           \
+                                                                            \
+static inline type os_atomicExchange##bits(os_atomic##bits##_t *ptr,       \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    OS_ATOMIC_RMW(type, ldrex, strex, ptr, order, value);                   \
+}                                                                           \
+                                                                            \
+static inline bool os_atomicCompareExchange##bits(os_atomic##bits##_t *ptr,\
+        type *expected, type desired, os_atomicOrder_t order)               \
+{                                                                           \
+    type old;                                                               \
+    os_atomicFenceBefore(order);                                            \
+    do {                                                                    \
+        old = ldrex(ptr);                                                   \
+        if(old != *expected) {                                              \
+            __CLREX();                                                      \
+            *expected = old;                                                \
+            os_atomicFenceAfter(order);                                     \
+            return false;                                                   \
+        }                                                                   \
+    } while(strex(desired, ptr));                                           \
+    os_atomicFenceAfter(order);                                             \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline type os_atomicFetchAdd##bits(os_atomic##bits##_t *ptr,       \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    OS_ATOMIC_RMW(type, ldrex, strex, ptr, order, (type)(old + value));     \
+}                                                                           \
+                                                                            \
+static inline type os_atomicFetchOr##bits(os_atomic##bits##_t *ptr,        \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    OS_ATOMIC_RMW(type, ldrex, strex, ptr, order, (type)(old | value));     \
+}                                                                           \
+                                                                            \
+static inline type os_atomicFetchAnd##bits(os_atomic##bits##_t *ptr,       \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    OS_ATOMIC_RMW(type, ldrex, strex, ptr, order, (type)(old & value));     \
+}
+
+OS_ATOMIC_DEFINE(8, uint8_t, __LDREXB, __STREXB)
+OS_ATOMIC_DEFINE(16, uint16_t, __LDREXH, __STREXH)
+OS_ATOMIC_DEFINE(32, uint32_t, __LDREXW, __STREXW)
+
+#undef OS_ATOMIC_RMW
+
+#else
+typedef enum {
+    OS_ATOMIC_RELAXED = memory_order_relaxed,
+    OS_ATOMIC_ACQUIRE = memory_order_acquire,
+    OS_ATOMIC_RELEASE = memory_order_release,
+    OS_ATOMIC_ACQ_REL = memory_order_acq_rel,
+    OS_ATOMIC_SEQ_CST = memory_order_seq_cst
+} os_atomicOrder_t;
+
+typedef _Atomic uint8_t os_atomic8_t;
+typedef _Atomic uint16_t os_atomic16_t;
+typedef _Atomic uint32_t os_atomic32_t;
+
+/*
+ * C11 does not allow a release order on a load or an acquire order on a
+ * store, map those to the nearest valid order.
+ */
+static inline memory_order os_atomicLoadOrder(os_atomicOrder_t order)
+{
+    if(order == OS_ATOMIC_RELEASE)
+        return memory_order_relaxed;
+    if(order == OS_ATOMIC_ACQ_REL)
+        return memory_order_acquire;
+    return (memory_order)order;
+}
+
+static inline memory_order os_atomicStoreOrder(os_atomicOrder_t order)
+{
+    if(order == OS_ATOMIC_ACQUIRE)
+        return memory_order_relaxed;
+    if(order == OS_ATOMIC_ACQ_REL)
+        return memory_order_release;
+    return (memory_order)order;
+}
+
+#define OS_ATOMIC_DEFINE(bits, type)                                        \
+static inline type os_atomicLoad##bits(os_atomic##bits##_t *ptr,           \
+        os_atomicOrder_t order)                                             \
+{                                                                           \
+    return atomic_load_explicit(ptr, os_atomicLoadOrder(order));            \
+}                                                                           \
+                                                                            \
+static inline void os_atomicStore##bits(os_atomic##bits##_t *ptr,          \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    atomic_store_explicit(ptr, value, os_atomicStoreOrder(order));          \
+}                                                                           \
+                                                                            \
+static inline type os_atomicExchange##bits(os_atomic##bits##_t *ptr,       \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    return atomic_exchange_explicit(ptr, value, (memory_order)order);       \
+}                                                                           \
+                                                                            \
+static inline bool os_atomicCompareExchange##bits(os_atomic##bits##_t *ptr,\
+        type *expected, type desired, os_atomicOrder_t order)               \
+{                                                                           \
+    return atomic_compare_exchange_strong_explicit(ptr, expected, desired,  \
+            (memory_order)order, os_atomicLoadOrder(order));                \
+}                                                                           \
+                                                                            \
+static inline type os_atomicFetchAdd##bits(os_atomic##bits##_t *ptr,       \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    return atomic_fetch_add_explicit(ptr, value, (memory_order)order);      \
+}                                                                           \
+                                                                            \
+static inline type os_atomicFetchOr##bits(os_atomic##bits##_t *ptr,        \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    return atomic_fetch_or_explicit(ptr, value, (memory_order)order);       \
+}                                                                           \
+                                                                            \
+static inline type os_atomicFetchAnd##bits(os_atomic##bits##_t *ptr,       \
+        type value, os_atomicOrder_t order)                                 \
+{                                                                           \
+    return atomic_fetch_and_explicit(ptr, value, (memory_order)order);      \
+}
+
+OS_ATOMIC_DEFINE(8, uint8_t)
+OS_ATOMIC_DEFINE(16, uint16_t)
+OS_ATOMIC_DEFINE(32, uint32_t)
+#endif
+
+#undef OS_ATOMIC_DEFINE
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_ATOMIC_H */
+
+/**
+ *@}
+ **/
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_barrier Barriers
+ * @{
+ * @ingroup os
+ *
+ * @brief Reusable rendezvous point for a fixed number of threads
+ *
+ * @details Every participant calls os_barrierWait once per round. The call
+ * blocks until all participants arrived, after which the barrier is ready
+ * for the next round. Each participant is woken exactly once per round.
+ */
+
+#ifndef OS_BARRIER_H
+#define OS_BARRIER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_barrier *os_barrierHandle_t;
+
+/**
+ * @brief Create a new barrier.
+ * @param participants Number of threads that meet at the barrier.
+ * @return Handle to the new barrier. If it could not be created, NULL is
+ * returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_barrierHandle_t os_barrierNew(uint16_t participants);
+
+/**
+ * @brief Wait at the barrier until all participants arrived.
+ * @param handle Handle to the barrier.
+ * @retval  true If all participants arrived.
+ * @retval  false If the barrier could not be passed.
+ */
+bool os_barrierWait(os_barrierHandle_t handle);
+
+/**
+ * @brief Wait at the barrier with a given timeout.
+ * @details A participant that times out is taken off the barrier again, the
+ * round then needs it to call os_barrierWait again before it completes.
+ * @param handle Handle to the barrier.
+ * @param timeout Time in milliseconds to wait for the other participants.
+ * @retval  true If all participants arrived.
+ * @retval  false If the timeout expired.
+ */
+bool os_barrierTimedWait(os_barrierHandle_t handle, uint32_t timeout);
+
+/**
+ * @brief Delete a barrier.
+ * @details No thread may be waiting at the barrier.
+ * @param handle Handle to the barrier to delete.
+ */
+void os_barrierDelete(os_barrierHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_BARRIER_H */
+
+/**
+ *@}
+ **/
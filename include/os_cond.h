@@ -0,0 +1,104 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_cond Condition variables
+ * @{
+ * @ingroup os
+ *
+ * @brief Wait for a predicate on data protected by an os_mutex
+ *
+ * @details A thread locks the mutex, checks the predicate and calls
+ * os_condWait while it does not hold. The wait releases the mutex and takes
+ * it again before returning. Always check the predicate again after a wait.
+ * Waiters are woken in the order they started waiting.
+ */
+
+#ifndef OS_COND_H
+#define OS_COND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "os_mutex.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_cond *os_condHandle_t;
+
+/**
+ * @brief Create a new condition variable.
+ * @return Handle to the new condition variable. If it could not be created,
+ * NULL is returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_condHandle_t os_condNew(void);
+
+/**
+ * @brief Wait for the condition to be signalled.
+ * @details Atomically releases the mutex and waits. The mutex is locked again
+ * when this function returns.
+ * @param handle Handle to the condition variable.
+ * @param mutex Mutex protecting the predicate, locked by the caller.
+ */
+void os_condWait(os_condHandle_t handle, os_mutexHandle_t mutex);
+
+/**
+ * @brief Wait for the condition to be signalled with a given timeout.
+ * @details The mutex is locked again when this function returns, also when
+ * the timeout expired.
+ * @param handle Handle to the condition variable.
+ * @param mutex Mutex protecting the predicate, locked by the caller.
+ * @param timeout Time in milliseconds to wait for a signal.
+ * @retval  true If the condition was signalled.
+ * @retval  false If the timeout expired.
+ */
+bool os_condTimedWait(os_condHandle_t handle, os_mutexHandle_t mutex,
+        uint32_t timeout);
+
+/**
+ * @brief Wake up the thread that waits longest.
+ * @details Does nothing when no thread is waiting. The caller does not need
+ * to hold the mutex, but signalling with it held makes the order of events
+ * easier to reason about.
+ * @param handle Handle to the condition variable.
+ */
+void os_condSignal(os_condHandle_t handle);
+
+/**
+ * @brief Wake up all waiting threads.
+ * @param handle Handle to the condition variable.
+ */
+void os_condBroadcast(os_condHandle_t handle);
+
+/**
+ * @brief Delete a condition variable.
+ * @details No thread may be waiting for the condition.
+ * @param handle Handle to the condition variable to delete.
+ */
+void os_condDelete(os_condHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_COND_H */
+
+/**
+ *@}
+ **/
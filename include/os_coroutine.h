@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_coroutine Coroutines
+ * @{
+ * @ingroup os
+ *
+ * @brief Stackless coroutines that share the stack of one executor thread
+ *
+ * @details A coroutine is a function that is called again and again by its
+ * executor. The OS_CO_* macros store the line to resume at and return from
+ * the function, so a coroutine only costs its os_coroutine_t. Local variables
+ * are not kept across a yield, keep state in the args structure instead.
+ * A switch statement can not be used around a yield point.
+ *
+ * @code
+ * static void blink(os_coroutine_t *co)
+ * {
+ *     OS_CO_BEGIN(co);
+ *     while(1) {
+ *         nrf_gpio_pin_toggle(LED_1);
+ *         OS_CO_SLEEP(co, 500);
+ *     }
+ *     OS_CO_END(co);
+ * }
+ * @endcode
+ */
+
+#ifndef OS_COROUTINE_H
+#define OS_COROUTINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "os_thread.h"
+#include "os_semaphore.h"
+#include "os_timer.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_coroutine os_coroutine_t;
+typedef void(*os_coroutineCallback_t)(os_coroutine_t*);
+typedef struct os_coroutineExecutor *os_coroutineExecutorHandle_t;
+
+typedef enum {
+    CO_STATE_READY = 0,     /**< The coroutine can run*/
+    CO_STATE_SLEEPING,      /**< The coroutine waits for its wake time*/
+    CO_STATE_POLLING,       /**< The coroutine waits for a condition*/
+    CO_STATE_NOTIFY,        /**< The coroutine waits for a notification*/
+    CO_STATE_DONE           /**< The coroutine has ended*/
+} os_coroutineState_t;
+
+/**
+ * @brief Coroutine control data.
+ * @details Allocated by the application, typically statically. Do not access
+ * the members directly, except args.
+ */
+struct os_coroutine {
+    uint16_t line;                              /**< Line to resume at*/
+    volatile os_coroutineState_t state;         /**< Scheduling state*/
+    volatile bool notified;                     /**< Pending notification*/
+    uint32_t wakeTime;                          /**< Wake time when sleeping*/
+    os_coroutineCallback_t callback;            /**< Coroutine function*/
+    void *args;                                 /**< Application data of the coroutine*/
+    os_coroutineExecutorHandle_t executor;      /**< Executor running the coroutine*/
+    struct os_coroutine *next;                  /**< Next coroutine of the executor*/
+};
+
+typedef struct {
+    const char* name;               /**< Name of the executor thread*/
+    uint32_t stackSize;             /**< Stack size of the executor thread*/
+    os_threadPriorities_t priority; /**< Priority of the executor thread*/
+    uint32_t pollInterval;          /**< Interval in milliseconds to poll waiting conditions, at least 1*/
+} os_coroutineExecutorConfig_t;
+
+/**
+ * @brief Start of a coroutine function. Must be the first statement.
+ */
+#define OS_CO_BEGIN(co)     switch((co)->line) { case 0:
+
+/**
+ * @brief End of a coroutine function. Must be the last statement.
+ */
+#define OS_CO_END(co)       } (co)->line = 0; (co)->state = CO_STATE_DONE; return
+
+/**
+ * @brief Let the other coroutines of the executor run.
+ */
+#define OS_CO_YIELD(co) \
+    do { \
+        (co)->line = __LINE__; return; case __LINE__:; \
+    } while(0)
+
+/**
+ * @brief Sleep for an amount of milliseconds.
+ */
+#define OS_CO_SLEEP(co, ms) \
+    do { \
+        (co)->wakeTime = os_timerGetMs() + (ms); \
+        (co)->state = CO_STATE_SLEEPING; \
+        (co)->line = __LINE__; return; case __LINE__:; \
+    } while(0)
+
+/**
+ * @brief Wait until a condition is true.
+ * @details The condition is evaluated every pollInterval of the executor.
+ */
+#define OS_CO_WAIT_UNTIL(co, cond) \
+    do { \
+        (co)->line = __LINE__; case __LINE__: \
+        if(!(cond)) { (co)->state = CO_STATE_POLLING; return; } \
+    } while(0)
+
+/**
+ * @brief Wait until a semaphore could be decremented.
+ */
+#define OS_CO_AWAIT_SEM(co, sem)    OS_CO_WAIT_UNTIL(co, os_semTryWait(sem))
+
+/**
+ * @brief Wait for os_coroutineNotify or os_coroutineIsrNotify.
+ * @details Notifications do not count, several notifications before the
+ * wait wake the coroutine once.
+ */
+#define OS_CO_AWAIT_NOTIFY(co) \
+    do { \
+        (co)->line = __LINE__; case __LINE__: \
+        if(!os_coroutineTakeNotify(co)) { \
+            (co)->state = CO_STATE_NOTIFY; return; \
+        } \
+    } while(0)
+
+/**
+ * @brief Create a new coroutine executor.
+ * @details Creates the thread that runs the coroutines. The executor sleeps
+ * until the next coroutine wakes up or is notified. While a coroutine waits
+ * for a condition, it wakes up every pollInterval. A pollInterval of 0 would
+ * make the executor spin and starve lower priorities, so it is rejected.
+ * @param conf Configuration for the executor.
+ * @return Handle to the executor. If pollInterval is 0 or something went
+ * wrong, NULL is returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_coroutineExecutorHandle_t os_coroutineExecutorNew(
+        os_coroutineExecutorConfig_t *conf);
+
+/**
+ * @brief Start a coroutine on an executor.
+ * @param executor Handle to the executor.
+ * @param co Coroutine control data. Must stay valid until the coroutine ends.
+ * @param callback Coroutine function.
+ * @param args Application data, available as co->args.
+ */
+void os_coroutineStart(os_coroutineExecutorHandle_t executor,
+        os_coroutine_t *co, os_coroutineCallback_t callback, void *args);
+
+/**
+ * @brief Notify a coroutine.
+ * @details Wakes the coroutine if it waits in OS_CO_AWAIT_NOTIFY.
+ * @param co Coroutine to notify.
+ */
+void os_coroutineNotify(os_coroutine_t *co);
+
+/**
+ * @brief Notify a coroutine from an interrupt service routine.
+ * @details Same as os_coroutineNotify. This function is ISR safe, the other
+ * one not.
+ * @param co Coroutine to notify.
+ */
+void os_coroutineIsrNotify(os_coroutine_t *co);
+
+/**
+ * @brief Consume a pending notification. Used by OS_CO_AWAIT_NOTIFY.
+ * @param co Coroutine to test.
+ * @retval  true If a notification was pending.
+ * @retval  false If no notification was pending.
+ */
+bool os_coroutineTakeNotify(os_coroutine_t *co);
+
+/**
+ * @brief Test if a coroutine has ended.
+ * @param co Coroutine to test.
+ * @retval  true If the coroutine reached OS_CO_END.
+ * @retval  false If the coroutine is still running.
+ */
+bool os_coroutineIsDone(os_coroutine_t *co);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_COROUTINE_H */
+
+/**
+ *@}
+ **/
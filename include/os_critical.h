@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_critical Critical sections
+ * @{
+ * @ingroup os
+ *
+ * @brief Short sections that run with kernel interrupts masked
+ *
+ * @details A critical section masks every interrupt at or below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY through BASEPRI, so neither the
+ * scheduler nor an ISR that uses the OS can run inside it. Interrupts above
+ * that priority, like the SoftDevice, are not masked and must not touch data
+ * protected this way.
+ *
+ * Use a critical section instead of an os_mutex for updates of a few
+ * instructions: bumping a counter, swapping a pointer or linking a list node.
+ * Entering and leaving only writes BASEPRI, a mutex goes through the queue
+ * code and may switch context. No cycle counts have been measured for this
+ * tree yet. The TEST=bench build measures them on the target: compare
+ * benchResults.criticalCycles and benchResults.mutexCycles after
+ * subtracting benchResults.loopCycles.
+ *
+ * Every cycle spent inside a section is added to the interrupt latency of
+ * all masked interrupts. Keep sections below OS_CRITICAL_MAX_US, do not
+ * loop over data of unbounded length and never block or call a function
+ * that may block inside one. Use a mutex for anything longer.
+ */
+
+#ifndef OS_CRITICAL_H
+#define OS_CRITICAL_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/** Longest section in microseconds before it hurts interrupt latency */
+#define OS_CRITICAL_MAX_US      10
+
+typedef UBaseType_t os_criticalMask_t;
+
+/**
+ * @brief Enter a critical section from a thread.
+ * @details Sections nest, interrupts are unmasked by the outermost
+ * os_criticalExit.
+ */
+static inline void os_criticalEnter(void)
+{
+    taskENTER_CRITICAL();
+}
+
+/**
+ * @brief Leave a critical section entered with os_criticalEnter.
+ */
+static inline void os_criticalExit(void)
+{
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Enter a critical section from an interrupt.
+ * @return The previous mask, pass it to os_criticalIsrExit.
+ */
+static inline os_criticalMask_t os_criticalIsrEnter(void)
+{
+    return taskENTER_CRITICAL_FROM_ISR();
+}
+
+/**
+ * @brief Leave a critical section entered with os_criticalIsrEnter.
+ * @param mask The mask returned by the matching os_criticalIsrEnter.
+ */
+static inline void os_criticalIsrExit(os_criticalMask_t mask)
+{
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+static inline void os_criticalScopeExit(uint8_t *scope)
+{
+    (void)scope;
+    os_criticalExit();
+}
+
+static inline void os_criticalIsrScopeExit(os_criticalMask_t *mask)
+{
+    os_criticalIsrExit(*mask);
+}
+
+#define OS_CRITICAL_CONCAT_(a, b)   a##b
+#define OS_CRITICAL_CONCAT(a, b)    OS_CRITICAL_CONCAT_(a, b)
+
+/**
+ * @brief Critical section that lasts until the end of the enclosing block.
+ * @details Leaving the block in any way, including return and break, leaves
+ * the section.
+ */
+#define OS_CRITICAL_SCOPE()                                                 \
+    uint8_t OS_CRITICAL_CONCAT(os_criticalScope, __LINE__)                  \
+        __attribute__((cleanup(os_criticalScopeExit), unused)) =            \
+        (os_criticalEnter(), 0)
+
+/**
+ * @brief Interrupt safe variant of OS_CRITICAL_SCOPE.
+ */
+#define OS_CRITICAL_ISR_SCOPE()                                             \
+    os_criticalMask_t OS_CRITICAL_CONCAT(os_criticalScope, __LINE__)        \
+        __attribute__((cleanup(os_criticalIsrScopeExit), unused)) =         \
+        os_criticalIsrEnter()
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_CRITICAL_H */
+
+/**
+ *@}
+ **/
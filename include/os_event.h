@@ -0,0 +1,146 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_event Event flags
+ * @{
+ * @ingroup os
+ *
+ * @brief FreeRTOS event group abstraction layer
+ *
+ */
+
+#ifndef OS_EVENT_H
+#define OS_EVENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "os_isr.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Bits that can be used as event flags.
+ */
+#define OS_EVENT_BITS   0x00FFFFFFUL
+
+typedef EventGroupHandle_t os_eventHandle_t;
+typedef EventBits_t os_eventBits_t;
+
+/**
+ * @brief Create a new event flags object.
+ * @details All flags are cleared initially.
+ * @return Handle to the new event flags object. If it could not be created,
+ * NULL is returned.
+ */
+os_eventHandle_t os_eventNew(void);
+
+/**
+ * @brief Set event flags.
+ * @details Wakes up all threads whose wait condition is met.
+ * @param handle Handle to the event flags.
+ * @param bits Flags to set, within OS_EVENT_BITS.
+ * @return The flags at the time this function returns. Flags may already be
+ * cleared again by a woken thread.
+ */
+os_eventBits_t os_eventSet(os_eventHandle_t handle, os_eventBits_t bits);
+
+/**
+ * @brief Set event flags from an interrupt service routine.
+ * @details The flags are set by the timer task, because waking an unknown
+ * number of threads is not deterministic. This function is ISR safe, the
+ * other ones not.
+ * @param handle Handle to the event flags.
+ * @param bits Flags to set, within OS_EVENT_BITS.
+ * @retval  true If the request was queued to the timer task.
+ * @retval  false If the timer queue was full.
+ */
+bool os_eventIsrSet(os_eventHandle_t handle, os_eventBits_t bits);
+
+/**
+ * @brief Set event flags from an ISR context.
+ * @details Same as os_eventIsrSet, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the event flags.
+ * @param bits Flags to set, within OS_EVENT_BITS.
+ * @retval  true If the request was queued to the timer task.
+ * @retval  false If the timer queue was full.
+ */
+bool os_eventSetFromIsr(os_isrCtx_t *ctx, os_eventHandle_t handle,
+        os_eventBits_t bits);
+
+/**
+ * @brief Clear event flags.
+ * @param handle Handle to the event flags.
+ * @param bits Flags to clear.
+ * @return The flags before they were cleared.
+ */
+os_eventBits_t os_eventClear(os_eventHandle_t handle, os_eventBits_t bits);
+
+/**
+ * @brief Get the current event flags.
+ * @param handle Handle to the event flags.
+ * @return The current flags.
+ */
+os_eventBits_t os_eventGet(os_eventHandle_t handle);
+
+/**
+ * @brief Wait until any of the given flags is set.
+ * @param handle Handle to the event flags.
+ * @param bits Flags to wait for.
+ * @param clearOnExit If the flags in bits should be cleared when the wait
+ * succeeds.
+ * @param timeout Time in milliseconds to wait.
+ * @return The flags from bits that were set, 0 if the timeout expired.
+ */
+os_eventBits_t os_eventWaitAny(os_eventHandle_t handle, os_eventBits_t bits,
+        bool clearOnExit, uint32_t timeout);
+
+/**
+ * @brief Wait until all of the given flags are set.
+ * @param handle Handle to the event flags.
+ * @param bits Flags to wait for.
+ * @param clearOnExit If the flags in bits should be cleared when the wait
+ * succeeds.
+ * @param timeout Time in milliseconds to wait.
+ * @retval  true If all flags were set.
+ * @retval  false If the timeout expired.
+ */
+bool os_eventWaitAll(os_eventHandle_t handle, os_eventBits_t bits,
+        bool clearOnExit, uint32_t timeout);
+
+/**
+ * @brief Delete an event flags object.
+ * @details Threads waiting on the flags are woken up and see a timeout.
+ * @param handle Handle to the event flags to delete.
+ */
+void os_eventDelete(os_eventHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_EVENT_H */
+
+/**
+ *@}
+ **/
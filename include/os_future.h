@@ -0,0 +1,129 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_future Futures
+ * @{
+ * @ingroup os
+ *
+ * @brief One-shot result cell for request/response between threads
+ *
+ * @details A future holds one value that is set once, by a thread or an
+ * ISR, and read by one thread. It needs no heap, so it can live on the stack
+ * of the requesting thread:
+ * @code
+ * os_future_t reply = OS_FUTURE_INIT;
+ * sendRequest(&cmd, &reply);
+ * if(os_futureGet(&reply, &status, 100))
+ *     ...
+ * @endcode
+ * The waiting thread is woken through THREAD_NOTIFY_RESERVED_BIT in its
+ * mailbox. The other bits are left alone, so notifications and mailbox values
+ * sent to it for another reason while it waits are still pending when
+ * os_futureGet returns. Make sure the
+ * setter is done with the future before it goes out of scope, for example
+ * by waiting for it without a timeout.
+ */
+
+#ifndef OS_FUTURE_H
+#define OS_FUTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "os_isr.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    volatile uint32_t value;    /**<The result, valid once ready is set*/
+    volatile bool ready;        /**<If the result was set*/
+    TaskHandle_t waiter;        /**<Thread blocked in os_futureGet*/
+} os_future_t;
+
+/** Initializer for an os_future_t */
+#define OS_FUTURE_INIT  { .value = 0, .ready = false, .waiter = NULL }
+
+/**
+ * @brief Initialize a future.
+ * @param future The future to initialize.
+ */
+void os_futureInit(os_future_t *future);
+
+/**
+ * @brief Set the result of a future.
+ * @details Wakes the thread waiting for the future, if any.
+ * @param future The future to set.
+ * @param value The result, a pointer can be passed by casting it.
+ * @retval  true If the result was set.
+ * @retval  false If the future was already set.
+ */
+bool os_futureSet(os_future_t *future, uint32_t value);
+
+/**
+ * @brief Set the result of a future from an interrupt service routine.
+ * @details Same as os_futureSet. This function is ISR safe.
+ * @param future The future to set.
+ * @param value The result.
+ * @retval  true If the result was set.
+ * @retval  false If the future was already set.
+ */
+bool os_futureIsrSet(os_future_t *future, uint32_t value);
+
+/**
+ * @brief Set the result of a future from an ISR context.
+ * @details Same as os_futureIsrSet, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param future The future to set.
+ * @param value The result.
+ * @retval  true If the result was set.
+ * @retval  false If the future was already set.
+ */
+bool os_futureSetFromIsr(os_isrCtx_t *ctx, os_future_t *future,
+        uint32_t value);
+
+/**
+ * @brief Wait for the result of a future.
+ * @details Only one thread can wait for a future at a time.
+ * @param future The future to wait for.
+ * @param value Pointer to store the result in.
+ * @param timeout Time in milliseconds to wait for the result.
+ * @retval  true If the result was set.
+ * @retval  false If the timeout expired.
+ */
+bool os_futureGet(os_future_t *future, uint32_t *value, uint32_t timeout);
+
+/**
+ * @brief Check if the result of a future was set.
+ * @param future The future to check.
+ * @retval  true If the result was set.
+ * @retval  false If the result was not set yet.
+ */
+bool os_futureIsReady(os_future_t *future);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_FUTURE_H */
+
+/**
+ *@}
+ **/
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_isr ISR context
+ * @{
+ * @ingroup os
+ *
+ * @brief Batch the context switch of several OS calls in one interrupt
+ *
+ * @details Every os_...FromIsr function records in an ISR context whether it
+ * woke a thread with a higher priority than the interrupted one. The ISR
+ * calls os_isrExit once at the end, which requests at most one context
+ * switch for all calls together.
+ * @code
+ * void SPIM0_IRQHandler(void)
+ * {
+ *     os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+ *     os_semPostFromIsr(&ctx, rxDone);
+ *     os_semPostFromIsr(&ctx, txDone);
+ *     os_threadNotifyFromIsr(&ctx, spiThread);
+ *     os_isrExit(&ctx);
+ * }
+ * @endcode
+ * The os_...Isr... functions without a context are kept for single calls,
+ * they request the context switch themselves.
+ */
+
+#ifndef OS_ISR_H
+#define OS_ISR_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    BaseType_t woken;   /**<If a higher priority thread was woken*/
+} os_isrCtx_t;
+
+/** Initializer for an os_isrCtx_t */
+#define OS_ISR_CTX_INIT     { .woken = pdFALSE }
+
+/**
+ * @brief Reset an ISR context.
+ * @param ctx The ISR context.
+ */
+static inline void os_isrInit(os_isrCtx_t *ctx)
+{
+    ctx->woken = pdFALSE;
+}
+
+/**
+ * @brief Request a context switch if any call woke a higher priority thread.
+ * @details Call this once, at the end of the interrupt handler.
+ * @param ctx The ISR context.
+ */
+static inline void os_isrExit(os_isrCtx_t *ctx)
+{
+    portYIELD_FROM_ISR(ctx->woken);
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_ISR_H */
+
+/**
+ *@}
+ **/
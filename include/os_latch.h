@@ -0,0 +1,109 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_latch Countdown latches
+ * @{
+ * @ingroup os
+ *
+ * @brief One-shot countdown that releases all waiters when it reaches zero
+ *
+ * @details Threads and ISRs count the latch down, any number of threads can
+ * wait for it to reach zero. Once open, the latch stays open.
+ */
+
+#ifndef OS_LATCH_H
+#define OS_LATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_latch *os_latchHandle_t;
+
+/**
+ * @brief Create a new latch.
+ * @param count Number of count downs before the latch opens. A latch with
+ * a count of 0 is open immediately.
+ * @return Handle to the new latch. If it could not be created, NULL is
+ * returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_latchHandle_t os_latchNew(uint32_t count);
+
+/**
+ * @brief Count the latch down by one.
+ * @details Counting down an open latch has no effect.
+ * @param handle Handle to the latch.
+ */
+void os_latchCountDown(os_latchHandle_t handle);
+
+/**
+ * @brief Count the latch down by one from an ISR.
+ * @details If the last count down cannot be posted to the timer task, the
+ * count is restored to one and false is returned. The caller should retry,
+ * for example from its next interrupt or from a thread with
+ * os_latchCountDown.
+ * @param handle Handle to the latch.
+ * @retval  true If the latch is counted down.
+ * @retval  false If opening the latch could not be posted to the timer task.
+ */
+bool os_latchIsrCountDown(os_latchHandle_t handle);
+
+/**
+ * @brief Get the remaining count of the latch.
+ * @param handle Handle to the latch.
+ * @return Number of count downs left before the latch opens.
+ */
+uint32_t os_latchGetCount(os_latchHandle_t handle);
+
+/**
+ * @brief Wait until the latch opens.
+ * @param handle Handle to the latch.
+ * @retval  true If the latch is open.
+ * @retval  false If the latch did not open.
+ */
+bool os_latchWait(os_latchHandle_t handle);
+
+/**
+ * @brief Wait until the latch opens with a given timeout.
+ * @param handle Handle to the latch.
+ * @param timeout Time in milliseconds to wait for the latch.
+ * @retval  true If the latch is open.
+ * @retval  false If the timeout expired.
+ */
+bool os_latchTimedWait(os_latchHandle_t handle, uint32_t timeout);
+
+/**
+ * @brief Delete a latch.
+ * @details No thread may be waiting for the latch.
+ * @param handle Handle to the latch to delete.
+ */
+void os_latchDelete(os_latchHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_LATCH_H */
+
+/**
+ *@}
+ **/
@@ -29,6 +29,9 @@
 #include <stdlib.h>
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+#include "os_thread.h"
+#include "os_isr.h"
 
 #ifndef OS_MUTEX_H
 #define OS_MUTEX_H
@@ -37,7 +40,27 @@
 extern "C" {
 #endif
 
+#if OS_MUTEX_PROFILE
+typedef struct os_mutex *os_mutexHandle_t;
+#else
 typedef SemaphoreHandle_t os_mutexHandle_t;
+#endif
+typedef SemaphoreHandle_t os_mutexRecursiveHandle_t;
+typedef struct os_mutexCeiling *os_mutexCeilingHandle_t;
+
+#if OS_MUTEX_PROFILE
+typedef void(*os_mutexPrint_t)(const char*);
+
+typedef struct {
+    uint32_t lockCount;         /**< Number of successful locks*/
+    uint32_t contendedCount;    /**< Number of locks that found the mutex taken*/
+    uint32_t inheritCount;      /**< Number of locks that raised the owner's priority*/
+    uint64_t totalWait;         /**< Total time spent waiting for the mutex, in cycles*/
+    uint32_t maxWait;           /**< Longest wait for the mutex, in cycles*/
+    uint32_t maxHold;           /**< Longest time the mutex was held, in cycles*/
+    TaskHandle_t owner;         /**< Task that holds the mutex, NULL if free*/
+} os_mutexStats_t;
+#endif
 
 /**
  * @brief Create a new mutex object
@@ -87,6 +110,17 @@ bool os_mutexTimedLock(os_mutexHandle_t handle, uint32_t timeout);
  */
 bool os_mutexIsrLock(os_mutexHandle_t handle);
 
+/**
+ * @brief Lock a mutex from an ISR context.
+ * @details Same as os_mutexIsrLock, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the mutex to lock.
+ * @retval  true If the mutex was successfully locked.
+ * @retval  false If the mutex could not be locked.
+ */
+bool os_mutexLockFromIsr(os_isrCtx_t *ctx, os_mutexHandle_t handle);
+
 /**
  * @brief Unlock a mutex.
  * @param handle Handle to the mutex to unlock.
@@ -104,6 +138,17 @@ void os_mutexUnlock(os_mutexHandle_t handle);
  */
 bool os_mutexIsrUnLock(os_mutexHandle_t handle);
 
+/**
+ * @brief Unlock a mutex from an ISR context.
+ * @details Same as os_mutexIsrUnLock, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the mutex to unlock.
+ * @retval  true If the mutex was successfully unlocked.
+ * @retval  false If the mutex could not be unlocked.
+ */
+bool os_mutexUnlockFromIsr(os_isrCtx_t *ctx, os_mutexHandle_t handle);
+
 /**
  * @brief Delete a mutex object and the handle to it.
  * @details Do not delete a mutex while an object is still waiting for the mutex
@@ -112,6 +157,145 @@ bool os_mutexIsrUnLock(os_mutexHandle_t handle);
  */
 void os_mutexDelete(os_mutexHandle_t handle);
 
+#if OS_MUTEX_PROFILE
+/**
+ * @brief Get the profiling counters of a mutex.
+ * @details Only available when built with OS_MUTEX_PROFILE set to 1. Times
+ * are measured with the DWT cycle counter, which stops while the CPU sleeps
+ * in tickless idle. Locks from an ISR are not profiled.
+ * @param handle Handle to the mutex.
+ * @param stats Counters of the mutex.
+ */
+void os_mutexGetStats(os_mutexHandle_t handle, os_mutexStats_t *stats);
+
+/**
+ * @brief Reset the profiling counters of a mutex.
+ * @param handle Handle to the mutex.
+ */
+void os_mutexResetStats(os_mutexHandle_t handle);
+
+/**
+ * @brief Print the profiling counters of all mutexes.
+ * @details One line is printed per mutex.
+ * @param print Function to output one line, without newline.
+ * @note This function formats with snprintf, call it from a thread with a
+ * big stack.
+ */
+void os_mutexDumpStats(os_mutexPrint_t print);
+#endif
+
+/**
+ * @brief Create a new recursive mutex object
+ * @details A recursive mutex can be locked again by the thread that holds it.
+ * It must be unlocked as many times as it was locked before other threads can
+ * take it. Recursive mutexes can not be used from an ISR, debug builds
+ * assert on that.
+ * @return Handle to the new recursive mutex object.
+ */
+os_mutexRecursiveHandle_t os_mutexNewRecursive(void);
+
+/**
+ * @brief Lock a recursive mutex indefinitely.
+ * @param handle Handle to the recursive mutex to lock.
+ * @retval  true If the mutex was successfully lock.
+ * @retval  false If the mutex could not be locked.
+ */
+bool os_mutexRecursiveLock(os_mutexRecursiveHandle_t handle);
+
+/**
+ * @brief Try to lock a recursive mutex.
+ * @details Non-blocking way of locking a recursive mutex. This always
+ * succeeds for the thread that already holds the mutex.
+ * @param handle Handle to the recursive mutex to lock.
+ * @retval  true If the mutex was successfully lock.
+ * @retval  false If the mutex could not be locked.
+ */
+bool os_mutexRecursiveTryLock(os_mutexRecursiveHandle_t handle);
+
+/**
+ * @brief Lock a recursive mutex with a given timeout.
+ * @param handle Handle to the recursive mutex to lock.
+ * @param timeout Timeout to wait before bailing out.
+ * @retval  true If the mutex was successfully lock.
+ * @retval  false If the mutex could not be locked. Or the timeout expired.
+ */
+bool os_mutexRecursiveTimedLock(os_mutexRecursiveHandle_t handle,
+        uint32_t timeout);
+
+/**
+ * @brief Unlock a recursive mutex once.
+ * @param handle Handle to the recursive mutex to unlock.
+ * @retval  true If the mutex was unlocked once.
+ * @retval  false If the calling thread does not hold the mutex.
+ */
+bool os_mutexRecursiveUnlock(os_mutexRecursiveHandle_t handle);
+
+/**
+ * @brief Delete a recursive mutex object and the handle to it.
+ * @param handle Handle to the recursive mutex to be deleted.
+ */
+void os_mutexRecursiveDelete(os_mutexRecursiveHandle_t handle);
+
+/**
+ * @brief Create a new priority ceiling mutex object
+ * @details Uses the immediate priority ceiling protocol: the thread that
+ * locks the mutex runs at the ceiling priority until it unlocks it. When the
+ * ceiling is the highest priority of all threads that use the mutex, a
+ * thread is blocked at most once, for one critical section of a lower
+ * priority thread. Debug builds assert that no thread with a base priority
+ * above the ceiling locks the mutex. A priority the locker inherited from a
+ * normal mutex is left in effect. Ceiling mutexes can not be used from an
+ * ISR.
+ * @param ceilingPrio Highest priority of the threads that use the mutex.
+ * @return Handle to the new mutex object. If it could not be created, NULL
+ * is returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_mutexCeilingHandle_t os_mutexNewCeiling(os_threadPriorities_t ceilingPrio);
+
+/**
+ * @brief Lock a ceiling mutex indefinitely.
+ * @param handle Handle to the ceiling mutex to lock.
+ * @retval  true If the mutex was successfully lock.
+ * @retval  false If the mutex could not be locked.
+ */
+bool os_mutexCeilingLock(os_mutexCeilingHandle_t handle);
+
+/**
+ * @brief Try to lock a ceiling mutex.
+ * @param handle Handle to the ceiling mutex to lock.
+ * @retval  true If the mutex was successfully lock.
+ * @retval  false If the mutex could not be locked.
+ */
+bool os_mutexCeilingTryLock(os_mutexCeilingHandle_t handle);
+
+/**
+ * @brief Lock a ceiling mutex with a given timeout.
+ * @details The priority of the calling thread is restored if the timeout
+ * expires.
+ * @param handle Handle to the ceiling mutex to lock.
+ * @param timeout Timeout to wait before bailing out.
+ * @retval  true If the mutex was successfully lock.
+ * @retval  false If the mutex could not be locked. Or the timeout expired.
+ */
+bool os_mutexCeilingTimedLock(os_mutexCeilingHandle_t handle,
+        uint32_t timeout);
+
+/**
+ * @brief Unlock a ceiling mutex.
+ * @details The calling thread returns to the priority it had before it
+ * locked the mutex. Ceiling mutexes that are held at the same time must be
+ * unlocked in the reverse order they were locked.
+ * @param handle Handle to the ceiling mutex to unlock.
+ */
+void os_mutexCeilingUnlock(os_mutexCeilingHandle_t handle);
+
+/**
+ * @brief Delete a ceiling mutex object and the handle to it.
+ * @param handle Handle to the ceiling mutex to be deleted.
+ */
+void os_mutexCeilingDelete(os_mutexCeilingHandle_t handle);
+
 
 #ifdef  __cplusplus
 }
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_ringbuf Ring buffers
+ * @{
+ * @ingroup os
+ *
+ * @brief Lock-free single producer, single consumer ring buffer
+ *
+ * @details Streams fixed size elements, like sensor samples, from one
+ * producer to one consumer without locks or copies. The producer reserves
+ * space, writes the elements in place and commits them. The consumer peeks
+ * at the committed elements and releases them when it is done. The producer
+ * can be an ISR.
+ *
+ * The consumer sleeps in os_ringbufWait until at least watermark elements
+ * are available. It is woken once when a commit crosses the watermark, not
+ * for every element.
+ */
+
+#ifndef OS_RINGBUF_H
+#define OS_RINGBUF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "os_thread.h"
+#include "os_isr.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_ringbuf *os_ringbufHandle_t;
+
+typedef struct {
+    size_t elemSize;            /**<Size of an element in bytes*/
+    uint32_t capacity;          /**<Number of elements, a power of two*/
+    uint32_t watermark;         /**<Elements needed to wake the consumer*/
+    os_threadHandle_t consumer; /**<Consumer thread, NULL if not known yet*/
+} os_ringbufConfig_t;
+
+/**
+ * @brief Create a new ring buffer.
+ * @details When the consumer thread is given, it is woken through its task
+ * notification instead of a semaphore, see os_semConfig_t::owner.
+ * @param conf Configuration for the ring buffer.
+ * @return Handle to the new ring buffer. If it could not be created or the
+ * capacity is not a power of two, NULL is returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_ringbufHandle_t os_ringbufNew(os_ringbufConfig_t *conf);
+
+/**
+ * @brief Reserve space for new elements.
+ * @details Only the producer may call this. The space is contiguous, so
+ * less than count elements may be returned at the end of the buffer even
+ * if more are free.
+ * @param handle Handle to the ring buffer.
+ * @param data Set to the first reserved element.
+ * @param count Number of elements wanted.
+ * @return Number of elements reserved, 0 if the buffer is full.
+ */
+uint32_t os_ringbufReserve(os_ringbufHandle_t handle, void **data,
+        uint32_t count);
+
+/**
+ * @brief Make reserved elements available to the consumer.
+ * @param handle Handle to the ring buffer.
+ * @param count Number of elements to commit, at most the number reserved.
+ */
+void os_ringbufCommit(os_ringbufHandle_t handle, uint32_t count);
+
+/**
+ * @brief Commit elements from an interrupt service routine.
+ * @details Same as os_ringbufCommit. This function is ISR safe.
+ * @param handle Handle to the ring buffer.
+ * @param count Number of elements to commit.
+ */
+void os_ringbufIsrCommit(os_ringbufHandle_t handle, uint32_t count);
+
+/**
+ * @brief Commit elements from an ISR context.
+ * @details Same as os_ringbufIsrCommit, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the ring buffer.
+ * @param count Number of elements to commit.
+ */
+void os_ringbufCommitFromIsr(os_isrCtx_t *ctx, os_ringbufHandle_t handle,
+        uint32_t count);
+
+/**
+ * @brief Get the committed elements.
+ * @details Only the consumer may call this. Like os_ringbufReserve, the
+ * elements returned are contiguous.
+ * @param handle Handle to the ring buffer.
+ * @param data Set to the oldest element.
+ * @return Number of elements that can be read, 0 if the buffer is empty.
+ */
+uint32_t os_ringbufPeek(os_ringbufHandle_t handle, const void **data);
+
+/**
+ * @brief Give read elements back to the producer.
+ * @param handle Handle to the ring buffer.
+ * @param count Number of elements to release, at most the number peeked.
+ */
+void os_ringbufRelease(os_ringbufHandle_t handle, uint32_t count);
+
+/**
+ * @brief Wait until the buffer holds at least watermark elements.
+ * @details Only the consumer may call this.
+ * @param handle Handle to the ring buffer.
+ * @param timeout Time in milliseconds to wait.
+ * @retval  true If the watermark was reached.
+ * @retval  false If the timeout expired.
+ */
+bool os_ringbufWait(os_ringbufHandle_t handle, uint32_t timeout);
+
+/**
+ * @brief Get the number of committed elements.
+ * @param handle Handle to the ring buffer.
+ * @return Number of elements the consumer can read.
+ */
+uint32_t os_ringbufCount(os_ringbufHandle_t handle);
+
+/**
+ * @brief Delete a ring buffer.
+ * @param handle Handle to the ring buffer to delete.
+ */
+void os_ringbufDelete(os_ringbufHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_RINGBUF_H */
+
+/**
+ *@}
+ **/
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_rwlock Reader-writer locks
+ * @{
+ * @ingroup os
+ *
+ * @brief Shared/exclusive lock for data that is read often and written rarely
+ *
+ * @details Any number of readers can hold the lock at the same time, a writer
+ * holds it alone. Writers are preferred: once a writer waits, new readers
+ * block until it is done, so a stream of readers can not starve it.
+ * The lock does not do priority inheritance.
+ */
+
+#ifndef OS_RWLOCK_H
+#define OS_RWLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_rwlock *os_rwlockHandle_t;
+
+/**
+ * @brief Create a new reader-writer lock.
+ * @return Handle to the new lock. If it could not be created, NULL is
+ * returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_rwlockHandle_t os_rwlockNew(void);
+
+/**
+ * @brief Lock for reading indefinitely.
+ * @param handle Handle to the lock.
+ * @retval  true If the lock was taken.
+ * @retval  false If the lock could not be taken.
+ */
+bool os_rwlockReadLock(os_rwlockHandle_t handle);
+
+/**
+ * @brief Try to lock for reading.
+ * @details Returns immediately if a writer holds or waits for the lock.
+ * @param handle Handle to the lock.
+ * @retval  true If the lock was taken.
+ * @retval  false If the lock could not be taken.
+ */
+bool os_rwlockTryReadLock(os_rwlockHandle_t handle);
+
+/**
+ * @brief Lock for reading with a given timeout.
+ * @param handle Handle to the lock.
+ * @param timeout Time in milliseconds to wait for the lock.
+ * @retval  true If the lock was taken.
+ * @retval  false If the timeout expired.
+ */
+bool os_rwlockTimedReadLock(os_rwlockHandle_t handle, uint32_t timeout);
+
+/**
+ * @brief Release a read lock.
+ * @param handle Handle to the lock.
+ */
+void os_rwlockReadUnlock(os_rwlockHandle_t handle);
+
+/**
+ * @brief Lock for writing indefinitely.
+ * @param handle Handle to the lock.
+ * @retval  true If the lock was taken.
+ * @retval  false If the lock could not be taken.
+ */
+bool os_rwlockWriteLock(os_rwlockHandle_t handle);
+
+/**
+ * @brief Try to lock for writing.
+ * @param handle Handle to the lock.
+ * @retval  true If the lock was taken.
+ * @retval  false If the lock is held by a reader or writer.
+ */
+bool os_rwlockTryWriteLock(os_rwlockHandle_t handle);
+
+/**
+ * @brief Lock for writing with a given timeout.
+ * @param handle Handle to the lock.
+ * @param timeout Time in milliseconds to wait for the lock.
+ * @retval  true If the lock was taken.
+ * @retval  false If the timeout expired.
+ */
+bool os_rwlockTimedWriteLock(os_rwlockHandle_t handle, uint32_t timeout);
+
+/**
+ * @brief Release a write lock.
+ * @details Waiting writers are woken before waiting readers.
+ * @param handle Handle to the lock.
+ */
+void os_rwlockWriteUnlock(os_rwlockHandle_t handle);
+
+/**
+ * @brief Delete a reader-writer lock.
+ * @details Do not delete a lock that is held or waited for.
+ * @param handle Handle to the lock to delete.
+ */
+void os_rwlockDelete(os_rwlockHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_RWLOCK_H */
+
+/**
+ *@}
+ **/
@@ -21,6 +21,18 @@
  *
  * @brief FreeRTOS semaphore abstraction layer
  *
+ * @details A semaphore is backed by a FreeRTOS queue by default. When only
+ * one thread ever waits for it, set os_semConfig_t::owner to back it with
+ * the notification value of that thread instead. This direct mode is faster
+ * and does not allocate a queue, but:
+ * - only the owner can wait, debug builds assert on that;
+ * - it can not be waited for from an ISR;
+ * - maxCount is not enforced;
+ * - a thread can own one direct semaphore at a time, delete it before the
+ *   owner thread is deleted;
+ * - the owner can not use os_threadWait or os_threadNotify for anything else.
+ * Posts that are pending on the owner when the semaphore is created are
+ * kept, initCount is added to them.
  */
 
 #ifndef OS_SEMAPHORE_H
@@ -31,25 +43,31 @@
 #include <stdbool.h>
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "os_isr.h"
+#include "os_thread.h"
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
 typedef struct {
-    uint8_t initCount;      /**<Initial value of a counting semaphore*/
-    uint8_t maxCount;       /**<Maximum value of a counting semaphore*/
+    uint32_t initCount;     /**<Initial value of a counting semaphore*/
+    uint32_t maxCount;      /**<Maximum value of a counting semaphore*/
     bool binary;            /**<If the semaphore should be binary or not*/
+    os_threadHandle_t owner;/**<Only waiter in direct mode, NULL for a queue*/
 } os_semConfig_t;
 
-typedef SemaphoreHandle_t os_semHandle_t;
+typedef struct os_sem *os_semHandle_t;
 
 /**
  * @brief Create a new semaphore object
  * @details Creates a semaphore object and a handle to it later
  * used for waiting/posting.
  * @param conf Configuration struct for the new semaphore
- * @return Handle to the new semaphore object.
+ * @return Handle to the new semaphore object. If it could not be created,
+ * NULL is returned. In direct mode that is also the case when the owner
+ * finished or already owns a direct semaphore.
+ * @note This function uses dynamic memory allocation.
  */
 os_semHandle_t os_semNew(os_semConfig_t *conf);
 
@@ -95,6 +113,17 @@ bool os_semTimedWait(os_semHandle_t handle, uint32_t timeout);
  */
 bool os_semIsrWait(os_semHandle_t handle);
 
+/**
+ * @brief Try to decrement the value of a semaphore from an ISR context.
+ * @details Same as os_semIsrWait, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the semaphore to decrement.
+ * @retval  true If the semaphore was successfully decremented.
+ * @retval  false If the value could not be decremented.
+ */
+bool os_semWaitFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle);
+
 /**
  * @brief Increment the value of a semaphore.
  * @param handle Handle to the semaphore to increment.
@@ -112,6 +141,78 @@ void os_semPost(os_semHandle_t handle);
  */
 bool os_semIsrPost(os_semHandle_t handle);
 
+/**
+ * @brief Increase the value of a semaphore from an ISR context.
+ * @details Same as os_semIsrPost, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the semaphore to increment.
+ * @retval  true If the semaphore was successfully incremented.
+ * @retval  false If the value could not be incremented.
+ */
+bool os_semPostFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle);
+
+/**
+ * @brief Increment the value of a semaphore by several counts at once.
+ * @details All counts are added in one critical section, so waiting threads
+ * are woken at most once. A binary semaphore is posted once. Counts above
+ * maxCount are not attempted, and a direct semaphore adds all counts with
+ * one notification.
+ * @param handle Handle to the semaphore to increment.
+ * @param count Number of counts to add.
+ * @return The number of counts added, less than count if the semaphore
+ * reached its maximum value.
+ */
+uint32_t os_semPostN(os_semHandle_t handle, uint32_t count);
+
+/**
+ * @brief Increment the value of a semaphore by several counts from an
+ * interrupt service routine.
+ * @details Same as os_semPostN. This function is ISR safe.
+ * @param handle Handle to the semaphore to increment.
+ * @param count Number of counts to add.
+ * @return The number of counts added.
+ */
+uint32_t os_semIsrPostN(os_semHandle_t handle, uint32_t count);
+
+/**
+ * @brief Increment the value of a semaphore by several counts from an ISR
+ * context.
+ * @details Same as os_semIsrPostN, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the semaphore to increment.
+ * @param count Number of counts to add.
+ * @return The number of counts added.
+ */
+uint32_t os_semPostNFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle,
+        uint32_t count);
+
+/**
+ * @brief Decrement the value of a semaphore by several counts.
+ * @details Blocks until all counts are taken. Counts that are available are
+ * taken right away, so a batch posted with os_semPostN is taken in one go.
+ * A binary semaphore is taken once.
+ * @param handle Handle to the semaphore to decrement.
+ * @param count Number of counts to take.
+ * @return The number of counts taken.
+ */
+uint32_t os_semWaitN(os_semHandle_t handle, uint32_t count);
+
+/**
+ * @brief Decrement the value of a semaphore by several counts with a
+ * timeout.
+ * @details Same as os_semWaitN, but gives up when the timeout expires. With
+ * a timeout of 0 it takes whatever is available, up to count.
+ * @param handle Handle to the semaphore to decrement.
+ * @param count Number of counts to take.
+ * @param timeout Time to block until all counts are taken.
+ * @return The number of counts taken, less than count if the timeout
+ * expired.
+ */
+uint32_t os_semTimedWaitN(os_semHandle_t handle, uint32_t count,
+        uint32_t timeout);
+
 /**
  * @brief Delete a semaphore object.
  * @details Delete a semaphore object created with os_semNew.
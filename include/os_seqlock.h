@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_seqlock Sequence locks
+ * @{
+ * @ingroup os
+ *
+ * @brief Lock-free publishing of state from one writer to many readers
+ *
+ * @details The writer fills one of two buffers and publishes it by bumping
+ * a sequence counter, it never blocks and never waits for readers. Readers
+ * copy the published buffer and retry when a publish happened while they
+ * copied. Readers never block the writer and never change priorities.
+ *
+ * An ISR reader can not be preempted by the writer thread, so it reads a
+ * buffer the writer does not touch and never retries. The writer must be a
+ * single thread, or an ISR of a lower priority than all ISR readers.
+ */
+
+#ifndef OS_SEQLOCK_H
+#define OS_SEQLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct os_seqlock *os_seqlockHandle_t;
+
+/**
+ * @brief Create a new sequence lock.
+ * @details The initial state is all zeroes.
+ * @param size Size in bytes of the published state.
+ * @return Handle to the new sequence lock. If it could not be created,
+ * NULL is returned.
+ * @note This function uses dynamic memory allocation.
+ */
+os_seqlockHandle_t os_seqlockNew(size_t size);
+
+/**
+ * @brief Publish a new state.
+ * @param handle Handle to the sequence lock.
+ * @param data State to publish, of the size given at creation.
+ */
+void os_seqlockWrite(os_seqlockHandle_t handle, const void *data);
+
+/**
+ * @brief Get the buffer for the next state.
+ * @details Lets the writer build the next state in place. The buffer holds
+ * the state before the last published one. Readers do not see any of it
+ * until os_seqlockWriteEnd is called.
+ * @param handle Handle to the sequence lock.
+ * @return Buffer of the size given at creation, aligned to 8 bytes.
+ */
+void *os_seqlockWriteBegin(os_seqlockHandle_t handle);
+
+/**
+ * @brief Publish the buffer returned by os_seqlockWriteBegin.
+ * @param handle Handle to the sequence lock.
+ */
+void os_seqlockWriteEnd(os_seqlockHandle_t handle);
+
+/**
+ * @brief Copy the latest published state.
+ * @details Can be called from threads and ISRs.
+ * @param handle Handle to the sequence lock.
+ * @param data Buffer of the size given at creation to copy the state to.
+ * @return The sequence number of the copied state.
+ */
+uint32_t os_seqlockRead(os_seqlockHandle_t handle, void *data);
+
+/**
+ * @brief Get the sequence number of the latest published state.
+ * @details The number increases by one with every publish, readers can use
+ * it to skip copying a state they already have.
+ * @param handle Handle to the sequence lock.
+ * @return The sequence number.
+ */
+uint32_t os_seqlockGetSequence(os_seqlockHandle_t handle);
+
+/**
+ * @brief Delete a sequence lock.
+ * @param handle Handle to the sequence lock to delete.
+ */
+void os_seqlockDelete(os_seqlockHandle_t handle);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_SEQLOCK_H */
+
+/**
+ *@}
+ **/
@@ -31,58 +31,269 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "os_isr.h"
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Linker section for statically allocated thread stacks.
+ * @details The section is defined in the linker script. It is not initialized
+ * at startup.
+ */
+#define OS_THREAD_STACK_SECTION ".os_stack"
+
+/**
+ * @brief Define a thread stack in the default stack section.
+ * @param name Name of the stack buffer.
+ * @param size Size of the stack in words.
+ */
+#define OS_THREAD_STACK_DEFINE(name, size) \
+    OS_THREAD_STACK_DEFINE_IN(name, size, OS_THREAD_STACK_SECTION)
+
+/**
+ * @brief Define a thread stack in a given linker section.
+ * @param name Name of the stack buffer.
+ * @param size Size of the stack in words.
+ * @param sect Name of the linker section to place the stack in.
+ */
+#define OS_THREAD_STACK_DEFINE_IN(name, size, sect) \
+    StackType_t name[size] __attribute__((section(sect), aligned(8)))
+
+/**
+ * @brief Frequency of the counter used for the run time statistics.
+ * @details The statistics use the RTC that also drives the scheduler tick,
+ * so they keep counting while the CPU sleeps.
+ */
+#define OS_THREAD_STATS_HZ  32768UL
+
+/**
+ * @brief Number of thread local storage slots available to the application.
+ * @details Slot 0 of the FreeRTOS thread local storage is used by the OS
+ * layer itself.
+ */
+#define OS_THREAD_LOCAL_COUNT   (configNUM_THREAD_LOCAL_STORAGE_POINTERS - 1)
+
+/**
+ * @brief Threshold to flag a thread as oversized in os_threadStackReport.
+ * @details A thread is oversized when its stack is more than this percentage
+ * larger than the recommended size.
+ */
+#ifndef OS_STACK_OVERSIZE_PERCENT
+#define OS_STACK_OVERSIZE_PERCENT   50
+#endif
+
 typedef void(*os_threadCallback_t)(void*);
+typedef void(*os_threadPrint_t)(const char*);
 typedef struct os_threadHandle *os_threadHandle_t;
 
+/**
+ * @brief Thread bookkeeping data.
+ * @details Only exposed so it can be allocated statically with
+ * os_threadStorage_t. Do not access the members directly.
+ */
+struct os_threadHandle {
+    TaskHandle_t threadHandle;      /**< Handle to the FreeRTOS task*/
+    bool isStatic;                  /**< If the memory is owned by the caller*/
+    const char *name;               /**< Name of the thread*/
+    uint32_t stackSize;             /**< Stack size of the thread in words*/
+    os_threadCallback_t callback;   /**< Code to execute in the thread*/
+    void *args;                     /**< Arguments to pass to the callback*/
+    uint32_t period;                /**< Period of a periodic thread in milliseconds*/
+    uint32_t execTime;              /**< Worst case run time of one period in milliseconds*/
+    uint32_t overruns;              /**< Number of missed periods*/
+    uint8_t *scratch;               /**< Scratch arena of the thread*/
+    uint32_t scratchSize;           /**< Size of the scratch arena in bytes*/
+    uint32_t scratchUsed;           /**< Bytes allocated from the scratch arena*/
+    bool scratchOwned;              /**< If the scratch arena was allocated by the OS layer*/
+    bool finished;                  /**< If the thread callback has returned*/
+    bool directSem;                 /**< If a direct semaphore owns the task notification*/
+    uint32_t stackFree;             /**< Minimum free stack words when the thread finished*/
+    SemaphoreHandle_t joinSem;      /**< Given when the thread finishes*/
+    StaticSemaphore_t joinBuffer;   /**< Storage for the join semaphore*/
+    struct os_threadHandle *next;   /**< Next thread in the thread list*/
+#if OS_THREAD_STATS
+    uint32_t runTime;               /**< Accumulated run time in counter ticks*/
+    uint32_t switchedIn;            /**< Counter value when switched in*/
+    uint32_t switchCount;           /**< Number of times switched in*/
+    uint32_t lastRunTime;           /**< Run time at the previous query*/
+    TickType_t lastTick;            /**< Scheduler tick at the previous query*/
+#endif
+};
+
+typedef struct {
+    struct os_threadHandle handle;  /**< Storage for the thread handle*/
+    StaticTask_t taskBuffer;        /**< Storage for the task control block*/
+} os_threadStorage_t;
+
 typedef enum {
     STACK_SIZE_MINIMUM = 100,   /**< Minimum stacksize*/
     STACK_SIZE_DEFAULT = 150,   /**< Stack size for regular threads*/
     STACK_SIZE_BIG = 256        /**< Stack size for big threads*/
 } os_stackSizes_t;
 
+/**
+ * @brief Thread priorities.
+ * @details The levels are spread over the scheduler priorities, so they do
+ * not depend on configMAX_PRIORITIES. Levels may share a scheduler priority
+ * when there are fewer scheduler priorities than levels.
+ */
 typedef enum {
-    THREAD_PRIO_LOW = 0,    /**< Lowest thread priority*/
-    THREAD_PRIO_NORM,       /**< Normal thread priority*/
-    THREAD_PRIO_HIGH        /**< Highest thread priority*/
+    THREAD_PRIO_LOW = 0,        /**< Lowest thread priority*/
+    THREAD_PRIO_BELOW_NORM,     /**< Below normal thread priority*/
+    THREAD_PRIO_NORM,           /**< Normal thread priority*/
+    THREAD_PRIO_ABOVE_NORM,     /**< Above normal thread priority*/
+    THREAD_PRIO_HIGH,           /**< Highest thread priority*/
+    THREAD_PRIO_COUNT           /**< Number of thread priority levels*/
 } os_threadPriorities_t;
 
+/**
+ * Mailbox bit reserved for waking a thread in os_futureGet. Do not set it
+ * with os_threadNotifyValue.
+ */
+#define THREAD_NOTIFY_RESERVED_BIT  0x80000000UL
+
+typedef enum {
+    THREAD_NOTIFY_SET_BITS = 0,     /**< OR the value into the mailbox*/
+    THREAD_NOTIFY_INCREMENT,        /**< Increment the mailbox, the value is ignored*/
+    THREAD_NOTIFY_OVERWRITE,        /**< Replace the mailbox with the value*/
+    THREAD_NOTIFY_NO_OVERWRITE      /**< Replace the mailbox only if it was read*/
+} os_threadNotifyMode_t;
+
 typedef struct {
     const char* name;                   /**< Name of the thread*/
     os_threadCallback_t threadCallback; /**< Code to execute in the thread*/
     void* threadArgs;                   /**< Arguments to pass to the thread callback*/
     uint32_t stackSize;                 /**< Amount of stack memory the thread may use*/
     os_threadPriorities_t priority;     /**< The thread priority for the scheduler*/
+    StackType_t *stackBuffer;           /**< Stack memory of stackSize words for a static thread*/
+    os_threadStorage_t *storage;        /**< Handle and control block memory for a static thread*/
+    uint32_t period;                    /**< Run the callback every period milliseconds, 0 to run it once*/
+    uint32_t execTime;                  /**< Worst case run time of one period in milliseconds*/
+    uint32_t scratchSize;               /**< Size of the scratch arena in bytes, 0 for none*/
+    void *scratchBuffer;                /**< 8 byte aligned memory for the scratch arena, NULL to allocate it*/
 } os_threadConfig_t;
 
+typedef struct {
+    const char *name;       /**< Name of the thread*/
+    uint32_t runTime;       /**< Total time the thread ran, in OS_THREAD_STATS_HZ ticks*/
+    uint8_t cpuPercent;     /**< CPU usage since the previous query, in percent*/
+    uint32_t switchCount;   /**< Number of times the thread was switched in*/
+    uint32_t stackSize;     /**< Stack size of the thread in words*/
+    uint32_t stackFree;     /**< Minimum amount of free stack words so far*/
+} os_threadStats_t;
+
 /**
  * @brief Create and deploy a new thread. The thread will not run until
  * os_startSchedular() is called.
+ * @details If a period is set in the configuration, the callback must return.
+ * It is then called again at a fixed cadence with os_threadDelayUntil.
+ * Otherwise the callback is called once and the thread finishes when it
+ * returns. The memory of a finished thread is released by os_threadJoin or
+ * os_threadDelete.
  * @param   conf  Configuration structure for the thread.
  * @return  A handle to the currently created thread. If something went wrong,
  * NULL is returned.
- * @note    This function uses dynamic memory allocation
+ * @note    This function uses dynamic memory allocation, unless both
+ * stackBuffer and storage are set in the configuration. In that case the
+ * thread is created with os_threadNewStatic.
  */
 os_threadHandle_t os_threadNew(os_threadConfig_t *conf);
 
+/**
+ * @brief Create and deploy a new thread without using the heap.
+ * @details The stack, handle and task control block are taken from the
+ * stackBuffer and storage fields of the configuration. Both must stay valid
+ * for the lifetime of the thread. Use OS_THREAD_STACK_DEFINE to place the
+ * stack in a dedicated linker section.
+ * @param   conf  Configuration structure for the thread.
+ * @return  A handle to the currently created thread. If stackBuffer or
+ * storage is missing, or a scratch arena is requested without a
+ * scratchBuffer, NULL is returned.
+ */
+os_threadHandle_t os_threadNewStatic(os_threadConfig_t *conf);
+
 /**
  * @brief Start the OS task scheduler. This will cause the created threads to run.
- * @return false If the scheduler could not be started because of insufficient
- * ram. If the device runs out of ram after it started, this function will return
- * as well.
+ * @details The periodic threads created so far are first checked with the
+ * same utilization bound as os_threadIsSchedulable, using the execTime and
+ * period of their configurations. If the bound is exceeded, debug builds
+ * assert and the scheduler is not started.
+ * @return false If the periodic threads are not schedulable, or if the
+ * scheduler could not be started because of insufficient ram. If the device
+ * runs out of ram after it started, this function will return as well.
  * @note This function should never return.
  */
-void os_startScheduler(void);
+bool os_startScheduler(void);
+
+/**
+ * @brief Get the scheduler priority of a thread priority level.
+ * @param prio Thread priority level.
+ * @return The FreeRTOS priority the level maps to.
+ */
+UBaseType_t os_threadKernelPriority(os_threadPriorities_t prio);
+
+/**
+ * @brief Change the priority of a thread.
+ * @details The new priority takes effect immediately. This can cause a
+ * context switch.
+ * Does nothing for a thread that finished.
+ * @param handle Handle to the thread, or NULL for the calling thread.
+ * @param prio New priority of the thread.
+ */
+void os_threadSetPriority(os_threadHandle_t handle, os_threadPriorities_t prio);
+
+/**
+ * @brief Get the priority of a thread.
+ * @details If the thread inherited a priority from a mutex, the inherited
+ * priority is returned.
+ * @param handle Handle to the thread, or NULL for the calling thread.
+ * @return The highest priority level that maps to the thread's current
+ * scheduler priority. THREAD_PRIO_LOW for a thread that finished.
+ */
+os_threadPriorities_t os_threadGetPriority(os_threadHandle_t handle);
+
+/**
+ * @brief Test if a set of periodic threads meets its deadlines.
+ * @details Uses the rate monotonic utilization bound: the threads are
+ * schedulable when the sum of execTime / period does not exceed
+ * n * (2^(1/n) - 1). The test is sufficient, not necessary. Configurations
+ * without a period are ignored.
+ * @param confs Configurations of the threads.
+ * @param count Number of configurations.
+ * @retval  true If the threads are schedulable.
+ * @retval  false If the utilization bound is exceeded.
+ * @note os_startScheduler runs the same check on the threads that were
+ * created. Call this first to handle a failure before creating them.
+ */
+bool os_threadIsSchedulable(os_threadConfig_t *confs[], size_t count);
+
+/**
+ * @brief Assign rate monotonic priorities to a set of periodic threads.
+ * @details The thread with the shortest period gets THREAD_PRIO_HIGH, the
+ * next period one level lower and so on. Threads with equal periods share a
+ * level, and levels below THREAD_PRIO_LOW are clamped. Call this on the
+ * configurations before os_threadNew. Configurations without a period are
+ * left untouched.
+ * @param confs Configurations of the threads.
+ * @param count Number of configurations.
+ * @return The result of os_threadIsSchedulable.
+ */
+bool os_threadAssignRmPriorities(os_threadConfig_t *confs[], size_t count);
 
 /**
  * @brief Stop a running thread.
+ * @details The thread is removed from the scheduler and marked as finished,
+ * so a thread waiting in os_threadJoin wakes up. The handle stays valid until
+ * it is joined or deleted. Stopping the calling thread is the same as
+ * os_threadExit.
  * @param handle    Handle to the thread to stop.
  * @retval  true    If the thread is stopped successfully.
- * @retval  false   If thread could not be stopped.
+ * @retval  false   If thread could not be stopped because it already finished.
  */
 bool os_threadStop(os_threadHandle_t handle);
 
@@ -92,7 +303,7 @@ bool os_threadStop(os_threadHandle_t handle);
  * to do this.
  * @param handle Handle to the thread to suspend.
  * @retval  true If the thread was paused successfully.
- * @retval  false If the the thread could not be paused.
+ * @retval  false If the the thread could not be paused, because it finished.
  */
 bool os_threadPause(os_threadHandle_t handle);
 
@@ -101,10 +312,33 @@ bool os_threadPause(os_threadHandle_t handle);
  * @details Resume a thread that was previous paused.
  * @param handle Handle to the thread that has to be resumed.
  * @retval  true If the thread was successfully resumed.
- * @retval  false If the thread could not be resumed.
+ * @retval  false If the thread could not be resumed, because it finished.
  */
 bool os_threadResume(os_threadHandle_t handle);
 
+/**
+ * @brief Delay the calling thread until a fixed point in time.
+ * @details Use this instead of os_timerDelay to run a loop at a fixed
+ * cadence. The wake time is advanced by exactly one period, so the time spent
+ * in the loop body does not add up. If the wake time has already passed, the
+ * function returns immediately.
+ * @param lastWake Time of the previous wake up in milliseconds. Initialize it
+ * with os_timerGetMs before the first call. It is updated by this function.
+ * @param period Period of the loop in milliseconds.
+ * @retval  true If the period was met.
+ * @retval  false If the wake time had already passed.
+ */
+bool os_threadDelayUntil(uint32_t *lastWake, uint32_t period);
+
+/**
+ * @brief Get the number of missed periods of a periodic thread.
+ * @details A period is missed when the callback takes longer than the period
+ * set in the thread configuration.
+ * @param handle Handle to the periodic thread.
+ * @return The number of missed periods.
+ */
+uint32_t os_threadGetOverruns(os_threadHandle_t handle);
+
 /**
  * @brief Let a thread sleep until it's been notified by another task.
  * @details Light weight alternative for (binary) semaphores. This must be
@@ -118,7 +352,7 @@ void os_threadWait(void);
  * @details Light weight alternative to (binary) semaphores. This wakes up
  * as task that is currently waiting.
  * @param handle Handle to the task to notify. Note that the task to notify
- * needs to be in a waiting state.
+ * needs to be in a waiting state. Nothing happens if the thread finished.
  */
 void os_threadNotify(os_threadHandle_t handle);
 
@@ -127,10 +361,86 @@ void os_threadNotify(os_threadHandle_t handle);
  * @details Light weight alternative to (binary) semaphores. This wakes up
  * as task that is currently waiting. This function is interrupt safe.
  * @param handle Handle to the task to notify. Note that the task to notify
- * needs to be in a waiting state.
+ * needs to be in a waiting state. Nothing happens if the thread finished.
  */
 void os_threadIsrNotify(os_threadHandle_t handle);
 
+/**
+ * @brief Notify a waiting task from an ISR context.
+ * @details Same as os_threadIsrNotify, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the task to notify.
+ */
+void os_threadNotifyFromIsr(os_isrCtx_t *ctx, os_threadHandle_t handle);
+
+/**
+ * @brief Let a thread sleep until it's been notified, with a timeout.
+ * @details Same as os_threadWait, but gives up when the timeout expires.
+ * @param timeout Time in milliseconds to wait for a notification.
+ * @retval  true If the thread was notified.
+ * @retval  false If the timeout expired.
+ */
+bool os_threadTimedWait(uint32_t timeout);
+
+/**
+ * @brief Wait for a value in the mailbox of the calling thread.
+ * @details Every thread has a 32 bit mailbox that other threads and
+ * interrupts can write with os_threadNotifyValue. This must be called by the
+ * thread that owns the mailbox.
+ * @param clearOnEntry Bits to clear in the mailbox before waiting.
+ * @param clearOnExit Bits to clear in the mailbox after a value was received.
+ * @param value The mailbox value before clearOnExit was applied. May be NULL.
+ * @param timeout Time in milliseconds to wait for a value.
+ * @retval  true If a value was received.
+ * @retval  false If the timeout expired.
+ */
+bool os_threadWaitValue(uint32_t clearOnEntry, uint32_t clearOnExit,
+        uint32_t *value, uint32_t timeout);
+
+/**
+ * @brief Write a value to the mailbox of a thread.
+ * @details Wakes up the thread if it is waiting in os_threadWaitValue,
+ * os_threadWait or os_threadTimedWait. THREAD_NOTIFY_RESERVED_BIT must not be
+ * set in THREAD_NOTIFY_SET_BITS mode.
+ * @param handle Handle to the thread to notify.
+ * @param value Value to write, see mode.
+ * @param mode How the value is combined with the mailbox.
+ * @retval  true If the mailbox was written.
+ * @retval  false If mode is THREAD_NOTIFY_NO_OVERWRITE and the previous
+ * value was not read yet, or if the thread finished.
+ */
+bool os_threadNotifyValue(os_threadHandle_t handle, uint32_t value,
+        os_threadNotifyMode_t mode);
+
+/**
+ * @brief Write a value to the mailbox of a thread from an interrupt.
+ * @details Same as os_threadNotifyValue. This function is interrupt safe.
+ * @param handle Handle to the thread to notify.
+ * @param value Value to write, see mode.
+ * @param mode How the value is combined with the mailbox.
+ * @retval  true If the mailbox was written.
+ * @retval  false If mode is THREAD_NOTIFY_NO_OVERWRITE and the previous
+ * value was not read yet, or if the thread finished.
+ */
+bool os_threadIsrNotifyValue(os_threadHandle_t handle, uint32_t value,
+        os_threadNotifyMode_t mode);
+
+/**
+ * @brief Write a value to the mailbox of a thread from an ISR context.
+ * @details Same as os_threadIsrNotifyValue, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the thread to notify.
+ * @param value Value to write, see mode.
+ * @param mode How the value is combined with the mailbox.
+ * @retval  true If the mailbox was written.
+ * @retval  false If mode is THREAD_NOTIFY_NO_OVERWRITE and the previous
+ * value was not read yet, or if the thread finished.
+ */
+bool os_threadNotifyValueFromIsr(os_isrCtx_t *ctx, os_threadHandle_t handle,
+        uint32_t value, os_threadNotifyMode_t mode);
+
 /**
  * @brief Test if a thread is running.
  * @param handle Handle to the thread to test.
@@ -149,15 +459,120 @@ bool os_threadIsPaused(os_threadHandle_t handle);
 
 /**
  * @brief Exit a thread.
- * @details This function must be called at the end of a thread callback. This
- * ensures that the thread is removed from the memory and schedulers task list.
+ * @details Finish the calling thread without returning from its callback.
+ * Returning from the callback has the same effect. The thread stops running
+ * and a thread waiting in os_threadJoin wakes up. Its memory is released when
+ * it is joined.
  * This should be called by the task itself.
  */
-void os_threadExit();
+void os_threadExit(void);
+
+/**
+ * @brief Wait for a thread to finish and release it.
+ * @details Blocks until the thread returned from its callback, called
+ * os_threadExit or was stopped. The task, its stack (for dynamic threads),
+ * the scratch arena and the handle are released. The handle must not be used
+ * after a successful join. A thread can only be joined once.
+ * @param handle Handle to the thread to join.
+ * @param timeout Time in milliseconds to wait for the thread to finish.
+ * @retval  true If the thread finished and was released.
+ * @retval  false If the timeout expired.
+ */
+bool os_threadJoin(os_threadHandle_t handle, uint32_t timeout);
+
+/**
+ * @brief Test if a thread has finished.
+ * @param handle Handle to the thread to test.
+ * @retval  true If the thread finished and can be joined without blocking.
+ * @retval  false If the thread is still alive.
+ */
+bool os_threadIsFinished(os_threadHandle_t handle);
+
+/**
+ * @brief Get the statistics of a thread.
+ * @details The run time, CPU usage and switch count are only collected when
+ * the project is built with OS_THREAD_STATS set to 1, otherwise they read 0.
+ * The CPU usage covers the time since the previous query of the same thread,
+ * or since its creation.
+ * @param handle Handle to the thread.
+ * @param stats Statistics of the thread.
+ */
+void os_threadGetStats(os_threadHandle_t handle, os_threadStats_t *stats);
+
+/**
+ * @brief Get the statistics of all threads created with os_threadNew.
+ * @details See os_threadGetStats. The scheduler is suspended while the thread
+ * list is traversed.
+ * @param stats Array to store the statistics in.
+ * @param maxCount Number of entries in the stats array.
+ * @return The number of threads stored in the stats array.
+ */
+size_t os_threadGetAllStats(os_threadStats_t *stats, size_t maxCount);
+
+/**
+ * @brief Generate a header with right-sized stack sizes for all threads.
+ * @details Stacks are painted at creation, so the high water mark of every
+ * thread is known after a representative run. For each thread a define
+ * STACK_SIZE_<NAME> is emitted with the used stack plus the safety margin.
+ * Characters of the name that can not be part of an identifier are replaced
+ * by '_'. Threads that share a name get one define with the largest
+ * recommendation among them.
+ * Threads whose stack is more than OS_STACK_OVERSIZE_PERCENT above the
+ * recommendation are marked in a comment. Threads that already finished are
+ * reported with their usage at exit. The output is a complete header file,
+ * one line per call of print.
+ * @param print Function to output one line of the header, without newline.
+ * @param marginPercent Safety margin to add to the used stack, in percent.
+ * @note This function formats with snprintf, call it from a thread with a
+ * big stack.
+ */
+void os_threadStackReport(os_threadPrint_t print, uint8_t marginPercent);
+
+/**
+ * @brief Get the handle of the calling thread.
+ * @return Handle to the calling thread, or NULL if it was not created with
+ * os_threadNew.
+ */
+os_threadHandle_t os_threadSelf(void);
+
+/**
+ * @brief Store a pointer in the local storage of the calling thread.
+ * @details Thread local storage needs no locking, every thread has its own
+ * set of slots.
+ * @param index Slot to store the pointer in, below OS_THREAD_LOCAL_COUNT.
+ * @param ptr Pointer to store.
+ */
+void os_threadSetLocal(uint8_t index, void *ptr);
+
+/**
+ * @brief Get a pointer from the local storage of the calling thread.
+ * @param index Slot to read, below OS_THREAD_LOCAL_COUNT.
+ * @return The pointer stored with os_threadSetLocal, or NULL.
+ */
+void *os_threadGetLocal(uint8_t index);
+
+/**
+ * @brief Allocate memory from the scratch arena of the calling thread.
+ * @details The arena is set up when the thread is created, see scratchSize
+ * in os_threadConfig_t. Allocation only moves a pointer and needs no
+ * locking. Memory is given back with os_threadScratchReset.
+ * @param size Number of bytes to allocate. It is rounded up to 8 bytes.
+ * @return Pointer to the memory, or NULL if the arena is exhausted.
+ */
+void *os_threadScratchAlloc(size_t size);
+
+/**
+ * @brief Release all scratch memory of the calling thread.
+ * @details Everything allocated with os_threadScratchAlloc becomes invalid.
+ * Typically called at the start of every processing loop.
+ */
+void os_threadScratchReset(void);
 
 /**
  * @brief Delete a thread.
- * @details Stop and delete a thread from the memory.
+ * @details Stop and delete a thread from the memory. The memory of a static
+ * thread is not freed, it can be reused after this call. A thread can not
+ * delete itself, use os_threadExit instead.
  * DO NOT call this function before os_threadNew.
  * @param handle Handle to the thread that must be deleted.
  */
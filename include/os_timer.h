@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "nrf.h"
 
 #ifdef  __cplusplus
 extern "C" {
@@ -71,6 +72,28 @@ uint32_t os_timerGetElapsed(uint32_t start);
  */
 bool os_timerIsElapsed(uint32_t start, uint32_t amount);
 
+/**
+ * @brief Start the CPU cycle counter.
+ * @details Enables the DWT cycle counter used by os_timerGetCycles. The
+ * counter stops while the CPU sleeps.
+ */
+static inline void os_timerCycleInit(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Get the CPU cycle counter.
+ * @details The counter wraps, use unsigned subtraction to get a duration.
+ * os_timerCycleInit must be called first.
+ * @return The number of CPU cycles since the counter was started.
+ */
+static inline uint32_t os_timerGetCycles(void)
+{
+    return DWT->CYCCNT;
+}
+
 /**
  * @brief Delay the current thread for certain amount of milliseconds
  * @param ms The amount of milliseconds to delay.
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ * @defgroup os_workqueue Work queues
+ * @{
+ * @ingroup os
+ *
+ * @brief Run short jobs on a fixed pool of worker threads
+ *
+ */
+
+#ifndef OS_WORKQUEUE_H
+#define OS_WORKQUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "os_thread.h"
+#include "os_isr.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef void(*os_workCallback_t)(void*);
+typedef struct os_workqueue *os_workqueueHandle_t;
+
+typedef struct {
+    const char* name;               /**< Name of the worker threads*/
+    uint8_t workerCount;            /**< Number of worker threads*/
+    uint32_t stackSize;             /**< Stack size of each worker thread*/
+    os_threadPriorities_t priority; /**< Priority of the worker threads*/
+    uint16_t queueLength;           /**< Maximum number of pending jobs*/
+} os_workqueueConfig_t;
+
+typedef struct {
+    uint32_t submitted;     /**< Number of jobs accepted by the queue*/
+    uint32_t dropped;       /**< Number of jobs rejected because the queue was full*/
+    uint32_t completed;     /**< Number of jobs that finished*/
+    uint16_t depth;         /**< Number of jobs currently pending*/
+    uint16_t maxDepth;      /**< Highest number of pending jobs seen*/
+    uint32_t totalLatency;  /**< Sum of the submit to start times in milliseconds*/
+    uint32_t maxLatency;    /**< Longest submit to start time in milliseconds*/
+} os_workqueueStats_t;
+
+/**
+ * @brief Create a new work queue.
+ * @details Creates the job queue and starts the worker threads. All workers
+ * share the same job queue, jobs are started in submission order.
+ * @param conf Configuration for the work queue.
+ * @return A handle to the work queue. If the queue or one of the workers
+ * could not be created, NULL is returned and the workers that were already
+ * started are deleted again.
+ * @note This function uses dynamic memory allocation.
+ */
+os_workqueueHandle_t os_workqueueNew(os_workqueueConfig_t *conf);
+
+/**
+ * @brief Submit a job to a work queue.
+ * @details The job is copied into the queue, this function never blocks.
+ * Jobs must return, a job that blocks occupies its worker.
+ * @param handle Handle to the work queue.
+ * @param callback Function to run on a worker thread.
+ * @param args Argument to pass to the callback.
+ * @retval  true If the job was queued.
+ * @retval  false If the queue was full.
+ */
+bool os_workSubmit(os_workqueueHandle_t handle, os_workCallback_t callback,
+        void *args);
+
+/**
+ * @brief Submit a job to a work queue from an interrupt service routine.
+ * @details Same as os_workSubmit. This function is ISR safe, the other one
+ * not.
+ * @param handle Handle to the work queue.
+ * @param callback Function to run on a worker thread.
+ * @param args Argument to pass to the callback.
+ * @retval  true If the job was queued.
+ * @retval  false If the queue was full.
+ */
+bool os_workIsrSubmit(os_workqueueHandle_t handle, os_workCallback_t callback,
+        void *args);
+
+/**
+ * @brief Submit a job to a work queue from an ISR context.
+ * @details Same as os_workIsrSubmit, but leaves the context switch to
+ * os_isrExit.
+ * @param ctx The ISR context.
+ * @param handle Handle to the work queue.
+ * @param callback Function to run on a worker thread.
+ * @param args Argument to pass to the callback.
+ * @retval  true If the job was queued.
+ * @retval  false If the queue was full.
+ */
+bool os_workSubmitFromIsr(os_isrCtx_t *ctx, os_workqueueHandle_t handle,
+        os_workCallback_t callback, void *args);
+
+/**
+ * @brief Get the counters of a work queue.
+ * @param handle Handle to the work queue.
+ * @param stats Counters of the work queue.
+ */
+void os_workqueueGetStats(os_workqueueHandle_t handle,
+        os_workqueueStats_t *stats);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* OS_WORKQUEUE_H */
+
+/**
+ *@}
+ **/
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_barrier.h"
+#include "os_event.h"
+#include "os_critical.h"
+#include "FreeRTOS.h"
+
+/*
+ * Each round waits on its own event bit. The two bits alternate, so the bit
+ * of the next round can be cleared while the waiters of the current round
+ * still look at theirs.
+ */
+#define ROUND_BIT(round)    ((os_eventBits_t)1 << (round))
+
+struct os_barrier {
+    os_eventHandle_t event;
+    uint16_t participants;
+    uint16_t arrived;
+    uint8_t round;
+};
+
+os_barrierHandle_t os_barrierNew(uint16_t participants)
+{
+    os_barrierHandle_t handle;
+    if(!participants)
+        return NULL;
+    handle = calloc(1, sizeof(struct os_barrier));
+    if(!handle)
+        return NULL;
+    handle->event = os_eventNew();
+    if(!handle->event) {
+        free(handle);
+        return NULL;
+    }
+    handle->participants = participants;
+    return handle;
+}
+
+bool os_barrierWait(os_barrierHandle_t handle)
+{
+    return os_barrierTimedWait(handle, portMAX_DELAY);
+}
+
+bool os_barrierTimedWait(os_barrierHandle_t handle, uint32_t timeout)
+{
+    uint8_t round;
+    bool last;
+
+    os_criticalEnter();
+    round = handle->round;
+    last = ++handle->arrived == handle->participants;
+    if(last) {
+        handle->arrived = 0;
+        handle->round ^= 1;
+    }
+    os_criticalExit();
+
+    if(last) {
+        /*
+         * Nobody can reach the next round before its bit is cleared, all
+         * other participants are still waiting for this round's bit.
+         */
+        os_eventClear(handle->event, ROUND_BIT(round ^ 1));
+        os_eventSet(handle->event, ROUND_BIT(round));
+        return true;
+    }
+    if(os_eventWaitAll(handle->event, ROUND_BIT(round), false, timeout))
+        return true;
+
+    os_criticalEnter();
+    /* The round may have completed right after the timeout */
+    last = handle->round != round;
+    if(!last)
+        handle->arrived--;
+    os_criticalExit();
+    return last;
+}
+
+void os_barrierDelete(os_barrierHandle_t handle)
+{
+    os_eventDelete(handle->event);
+    free(handle);
+}
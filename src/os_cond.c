@@ -0,0 +1,148 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_cond.h"
+#include "os_critical.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#if (configTICK_RATE_HZ != 1000)
+#define msToTicks(a)    (a / portTICK_PERIOD_MS)
+#else
+#define msToTicks(a)    a
+#endif
+
+/*
+ * Every waiter queues a node on its own stack with a private semaphore, so a
+ * signal always reaches a thread that was waiting when it was sent and can
+ * not be taken by a thread that starts waiting later.
+ */
+struct os_condWaiter {
+    StaticSemaphore_t semBuffer;
+    SemaphoreHandle_t sem;
+    struct os_condWaiter *next;
+};
+
+struct os_cond {
+    struct os_condWaiter *head;
+    struct os_condWaiter *tail;
+};
+
+static void waiterAppend(os_condHandle_t handle, struct os_condWaiter *waiter)
+{
+    waiter->next = NULL;
+    if(handle->tail)
+        handle->tail->next = waiter;
+    else
+        handle->head = waiter;
+    handle->tail = waiter;
+}
+
+static bool waiterRemove(os_condHandle_t handle, struct os_condWaiter *waiter)
+{
+    struct os_condWaiter **node = &handle->head;
+    struct os_condWaiter *prev = NULL;
+    while(*node && *node != waiter) {
+        prev = *node;
+        node = &(*node)->next;
+    }
+    if(!*node)
+        return false;
+    *node = waiter->next;
+    if(handle->tail == waiter)
+        handle->tail = prev;
+    return true;
+}
+
+static struct os_condWaiter *waiterPop(os_condHandle_t handle)
+{
+    struct os_condWaiter *waiter = handle->head;
+    if(waiter) {
+        handle->head = waiter->next;
+        if(!handle->head)
+            handle->tail = NULL;
+    }
+    return waiter;
+}
+
+os_condHandle_t os_condNew(void)
+{
+    return calloc(1, sizeof(struct os_cond));
+}
+
+void os_condWait(os_condHandle_t handle, os_mutexHandle_t mutex)
+{
+    (void)os_condTimedWait(handle, mutex, portMAX_DELAY);
+}
+
+bool os_condTimedWait(os_condHandle_t handle, os_mutexHandle_t mutex,
+        uint32_t timeout)
+{
+    struct os_condWaiter waiter;
+    bool signalled;
+
+    waiter.sem = xSemaphoreCreateBinaryStatic(&waiter.semBuffer);
+    os_criticalEnter();
+    waiterAppend(handle, &waiter);
+    os_criticalExit();
+
+    os_mutexUnlock(mutex);
+    signalled = xSemaphoreTake(waiter.sem, msToTicks(timeout));
+    if(!signalled) {
+        os_criticalEnter();
+        signalled = !waiterRemove(handle, &waiter);
+        os_criticalExit();
+        /*
+         * Already popped by a signal, wait for its give so the node is not
+         * used after this function returns.
+         */
+        if(signalled)
+            (void)xSemaphoreTake(waiter.sem, portMAX_DELAY);
+    }
+    os_mutexLock(mutex);
+    return signalled;
+}
+
+void os_condSignal(os_condHandle_t handle)
+{
+    struct os_condWaiter *waiter;
+    os_criticalEnter();
+    waiter = waiterPop(handle);
+    os_criticalExit();
+    if(waiter)
+        (void)xSemaphoreGive(waiter->sem);
+}
+
+void os_condBroadcast(os_condHandle_t handle)
+{
+    struct os_condWaiter *waiter;
+    os_criticalEnter();
+    waiter = handle->head;
+    handle->head = NULL;
+    handle->tail = NULL;
+    os_criticalExit();
+    while(waiter) {
+        /* The waiter may return as soon as it is given its semaphore */
+        struct os_condWaiter *next = waiter->next;
+        (void)xSemaphoreGive(waiter->sem);
+        waiter = next;
+    }
+}
+
+void os_condDelete(os_condHandle_t handle)
+{
+    free(handle);
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_coroutine.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define WAIT_FOREVER    portMAX_DELAY
+
+struct os_coroutineExecutor {
+    os_threadHandle_t thread;
+    os_coroutine_t *list;
+    uint32_t pollInterval;
+};
+
+static uint32_t minTimeout(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+/*
+ * os_coroutineStart may have added coroutines in front of co, so search the
+ * list again. Returns the link that now points to the next coroutine.
+ */
+static os_coroutine_t **unlinkCoroutine(os_coroutineExecutorHandle_t handle,
+        os_coroutine_t *co)
+{
+    os_coroutine_t **it;
+    taskENTER_CRITICAL();
+    for(it = &handle->list; *it != co; it = &(*it)->next)
+        ;
+    *it = co->next;
+    taskEXIT_CRITICAL();
+    return it;
+}
+
+static uint32_t runCoroutines(os_coroutineExecutorHandle_t handle)
+{
+    os_coroutine_t **it = &handle->list;
+    os_coroutine_t *co;
+    uint32_t timeout = WAIT_FOREVER;
+    uint32_t now = os_timerGetMs();
+    int32_t remaining;
+
+    while((co = *it) != NULL) {
+        if(co->state == CO_STATE_SLEEPING) {
+            remaining = (int32_t)(co->wakeTime - now);
+            if(remaining > 0) {
+                timeout = minTimeout(timeout, remaining);
+                it = &co->next;
+                continue;
+            }
+        } else if(co->state == CO_STATE_NOTIFY && !co->notified) {
+            it = &co->next;
+            continue;
+        }
+
+        co->state = CO_STATE_READY;
+        co->callback(co);
+        now = os_timerGetMs();
+
+        if(co->state == CO_STATE_DONE) {
+            it = unlinkCoroutine(handle, co);
+            continue;
+        }
+        if(co->state == CO_STATE_READY)
+            timeout = 0;
+        else if(co->state == CO_STATE_POLLING)
+            timeout = minTimeout(timeout, handle->pollInterval);
+        else if(co->state == CO_STATE_SLEEPING)
+            timeout = minTimeout(timeout, (int32_t)(co->wakeTime - now) > 0 ?
+                    co->wakeTime - now : 0);
+        else if(co->notified)
+            timeout = 0;
+        it = &co->next;
+    }
+    return timeout;
+}
+
+static void executorThread(void *args)
+{
+    os_coroutineExecutorHandle_t handle = args;
+    uint32_t timeout;
+    while(1) {
+        timeout = runCoroutines(handle);
+        if(timeout)
+            (void)os_threadTimedWait(timeout);
+    }
+}
+
+os_coroutineExecutorHandle_t os_coroutineExecutorNew(
+        os_coroutineExecutorConfig_t *conf)
+{
+    os_coroutineExecutorHandle_t handle;
+    configASSERT(conf->pollInterval != 0);
+    if(!conf->pollInterval)
+        return NULL;
+    handle = calloc(1, sizeof(struct os_coroutineExecutor));
+    if(!handle)
+        return NULL;
+    handle->pollInterval = conf->pollInterval;
+
+    os_threadConfig_t threadConf = {
+        .name = conf->name,
+        .threadCallback = executorThread,
+        .threadArgs = handle,
+        .stackSize = conf->stackSize,
+        .priority = conf->priority
+    };
+    handle->thread = os_threadNew(&threadConf);
+    if(!handle->thread) {
+        free(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+void os_coroutineStart(os_coroutineExecutorHandle_t executor,
+        os_coroutine_t *co, os_coroutineCallback_t callback, void *args)
+{
+    co->line = 0;
+    co->state = CO_STATE_READY;
+    co->notified = false;
+    co->callback = callback;
+    co->args = args;
+    co->executor = executor;
+    /* The executor only unlinks, so adding to the head is safe */
+    taskENTER_CRITICAL();
+    co->next = executor->list;
+    executor->list = co;
+    taskEXIT_CRITICAL();
+    os_threadNotify(executor->thread);
+}
+
+void os_coroutineNotify(os_coroutine_t *co)
+{
+    co->notified = true;
+    os_threadNotify(co->executor->thread);
+}
+
+void os_coroutineIsrNotify(os_coroutine_t *co)
+{
+    co->notified = true;
+    os_threadIsrNotify(co->executor->thread);
+}
+
+bool os_coroutineTakeNotify(os_coroutine_t *co)
+{
+    if(!co->notified)
+        return false;
+    co->notified = false;
+    return true;
+}
+
+bool os_coroutineIsDone(os_coroutine_t *co)
+{
+    return co->state == CO_STATE_DONE;
+}
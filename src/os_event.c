@@ -0,0 +1,80 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_event.h"
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "task.h"
+
+#if (configTICK_RATE_HZ != 1000)
+#define msToTicks(a)    (a / portTICK_PERIOD_MS)
+#else
+#define msToTicks(a)    a
+#endif
+
+os_eventHandle_t os_eventNew(void)
+{
+    return xEventGroupCreate();
+}
+
+os_eventBits_t os_eventSet(os_eventHandle_t handle, os_eventBits_t bits)
+{
+    return xEventGroupSetBits(handle, bits & OS_EVENT_BITS);
+}
+
+bool os_eventIsrSet(os_eventHandle_t handle, os_eventBits_t bits)
+{
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_eventSetFromIsr(&ctx, handle, bits);
+    os_isrExit(&ctx);
+    return ret;
+}
+
+bool os_eventSetFromIsr(os_isrCtx_t *ctx, os_eventHandle_t handle,
+        os_eventBits_t bits)
+{
+    return xEventGroupSetBitsFromISR(handle, bits & OS_EVENT_BITS,
+            &ctx->woken);
+}
+
+os_eventBits_t os_eventClear(os_eventHandle_t handle, os_eventBits_t bits)
+{
+    return xEventGroupClearBits(handle, bits & OS_EVENT_BITS);
+}
+
+os_eventBits_t os_eventGet(os_eventHandle_t handle)
+{
+    return xEventGroupGetBits(handle);
+}
+
+os_eventBits_t os_eventWaitAny(os_eventHandle_t handle, os_eventBits_t bits,
+        bool clearOnExit, uint32_t timeout)
+{
+    return xEventGroupWaitBits(handle, bits, clearOnExit, pdFALSE,
+            msToTicks(timeout)) & bits;
+}
+
+bool os_eventWaitAll(os_eventHandle_t handle, os_eventBits_t bits,
+        bool clearOnExit, uint32_t timeout)
+{
+    return (xEventGroupWaitBits(handle, bits, clearOnExit, pdTRUE,
+            msToTicks(timeout)) & bits) == bits;
+}
+
+void os_eventDelete(os_eventHandle_t handle)
+{
+    vEventGroupDelete(handle);
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_future.h"
+#include "os_thread.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if (configTICK_RATE_HZ != 1000)
+#define msToTicks(a)    (a / portTICK_PERIOD_MS)
+#else
+#define msToTicks(a)    a
+#endif
+
+/*
+ * The setter notifies inside its critical section, so a waiter that sees
+ * ready also knows the notification was sent and can take it back.
+ * Notifications are taken one at a time, so other notifications of the
+ * waiting thread are left alone.
+ */
+
+void os_futureInit(os_future_t *future)
+{
+    future->value = 0;
+    future->ready = false;
+    future->waiter = NULL;
+}
+
+bool os_futureSet(os_future_t *future, uint32_t value)
+{
+    bool ret = false;
+    taskENTER_CRITICAL();
+    if(!future->ready) {
+        future->value = value;
+        future->ready = true;
+        if(future->waiter)
+            (void)xTaskNotify(future->waiter, THREAD_NOTIFY_RESERVED_BIT,
+                    eSetBits);
+        ret = true;
+    }
+    taskEXIT_CRITICAL();
+    return ret;
+}
+
+bool os_futureIsrSet(os_future_t *future, uint32_t value)
+{
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_futureSetFromIsr(&ctx, future, value);
+    os_isrExit(&ctx);
+    return ret;
+}
+
+bool os_futureSetFromIsr(os_isrCtx_t *ctx, os_future_t *future,
+        uint32_t value)
+{
+    bool ret = false;
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    if(!future->ready) {
+        future->value = value;
+        future->ready = true;
+        if(future->waiter)
+            (void)xTaskNotifyFromISR(future->waiter,
+                    THREAD_NOTIFY_RESERVED_BIT, eSetBits, &ctx->woken);
+        ret = true;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return ret;
+}
+
+bool os_futureGet(os_future_t *future, uint32_t *value, uint32_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = msToTicks(timeout);
+    TickType_t elapsed;
+    uint32_t bits = 0;
+    bool foreign = false;
+    bool ready;
+
+    taskENTER_CRITICAL();
+    ready = future->ready;
+    if(!ready) {
+        configASSERT(future->waiter == NULL);
+        future->waiter = xTaskGetCurrentTaskHandle();
+    }
+    taskEXIT_CRITICAL();
+
+    while(!ready) {
+        elapsed = xTaskGetTickCount() - start;
+        if(ticks != portMAX_DELAY && elapsed >= ticks)
+            break;
+        /* Only the reserved bit is cleared, the rest of the mailbox stays */
+        if(xTaskNotifyWait(0, THREAD_NOTIFY_RESERVED_BIT, &bits,
+                ticks == portMAX_DELAY ? portMAX_DELAY : ticks - elapsed))
+            foreign |= bits != THREAD_NOTIFY_RESERVED_BIT;
+        ready = future->ready;
+    }
+
+    if(future->waiter) {
+        taskENTER_CRITICAL();
+        ready = future->ready;
+        future->waiter = NULL;
+        taskEXIT_CRITICAL();
+        /* Set after the last wait returned, clear the reserved bit */
+        if(ready && xTaskNotifyWait(0, THREAD_NOTIFY_RESERVED_BIT, &bits, 0))
+            foreign |= bits != THREAD_NOTIFY_RESERVED_BIT;
+    }
+    /*
+     * Waiting above marked the mailbox as read. Mark it pending again if
+     * something else was delivered, without changing its value.
+     */
+    if(foreign)
+        (void)xTaskNotify(xTaskGetCurrentTaskHandle(), 0, eSetBits);
+    if(ready)
+        *value = future->value;
+    return ready;
+}
+
+bool os_futureIsReady(os_future_t *future)
+{
+    return future->ready;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_latch.h"
+#include "os_event.h"
+#include "os_critical.h"
+#include "FreeRTOS.h"
+
+#define LATCH_OPEN  ((os_eventBits_t)1)
+
+struct os_latch {
+    os_eventHandle_t event;
+    uint32_t count;
+};
+
+os_latchHandle_t os_latchNew(uint32_t count)
+{
+    os_latchHandle_t handle = calloc(1, sizeof(struct os_latch));
+    if(!handle)
+        return NULL;
+    handle->event = os_eventNew();
+    if(!handle->event) {
+        free(handle);
+        return NULL;
+    }
+    handle->count = count;
+    if(!count)
+        os_eventSet(handle->event, LATCH_OPEN);
+    return handle;
+}
+
+void os_latchCountDown(os_latchHandle_t handle)
+{
+    bool open = false;
+    os_criticalEnter();
+    if(handle->count)
+        open = --handle->count == 0;
+    os_criticalExit();
+    if(open)
+        os_eventSet(handle->event, LATCH_OPEN);
+}
+
+bool os_latchIsrCountDown(os_latchHandle_t handle)
+{
+    bool open = false;
+    os_criticalMask_t mask = os_criticalIsrEnter();
+    if(handle->count)
+        open = --handle->count == 0;
+    os_criticalIsrExit(mask);
+    if(open && !os_eventIsrSet(handle->event, LATCH_OPEN)) {
+        /* Take the count down back so the caller can retry it */
+        mask = os_criticalIsrEnter();
+        handle->count = 1;
+        os_criticalIsrExit(mask);
+        return false;
+    }
+    return true;
+}
+
+uint32_t os_latchGetCount(os_latchHandle_t handle)
+{
+    return handle->count;
+}
+
+bool os_latchWait(os_latchHandle_t handle)
+{
+    return os_latchTimedWait(handle, portMAX_DELAY);
+}
+
+bool os_latchTimedWait(os_latchHandle_t handle, uint32_t timeout)
+{
+    return os_eventWaitAll(handle->event, LATCH_OPEN, false, timeout);
+}
+
+void os_latchDelete(os_latchHandle_t handle)
+{
+    os_eventDelete(handle->event);
+    free(handle);
+}
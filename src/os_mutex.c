@@ -15,54 +15,355 @@
  */
 
 #include "os_mutex.h"
+#include <stddef.h>
+#include <string.h>
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "task.h"
 
+/* Catch use of thread only functions from an ISR in debug builds */
+#define assertNotIsr()  configASSERT(__get_IPSR() == 0)
+
+#if OS_MUTEX_PROFILE
+#include <stdio.h>
+#include "os_timer.h"
+
+#define mutexSem(handle)            ((handle)->sem)
+#define mutexTake(handle, timeout)  profiledTake(handle, timeout)
+#define mutexGive(handle)           profiledGive(handle)
+
+struct os_mutex {
+    SemaphoreHandle_t sem;
+    os_mutexStats_t stats;
+    uint32_t lockedAt;
+    struct os_mutex *next;
+};
+
+static os_mutexHandle_t mutexList;
+
+/*
+ * The counters are only written by the thread that holds the mutex, so they
+ * need no extra locking.
+ */
+static bool profiledTake(os_mutexHandle_t handle, TickType_t timeout)
+{
+    uint32_t start = os_timerGetCycles();
+    uint32_t wait;
+    bool contended = false;
+    bool inherited = false;
+    TaskHandle_t owner;
+
+    if(!xSemaphoreTake(handle->sem, 0)) {
+        if(!timeout)
+            return false;
+        contended = true;
+        owner = handle->stats.owner;
+        inherited = owner && uxTaskPriorityGet(owner) < uxTaskPriorityGet(NULL);
+        if(!xSemaphoreTake(handle->sem, timeout))
+            return false;
+    }
+    handle->lockedAt = os_timerGetCycles();
+    wait = handle->lockedAt - start;
+    handle->stats.owner = xTaskGetCurrentTaskHandle();
+    handle->stats.lockCount++;
+    if(contended) {
+        handle->stats.contendedCount++;
+        handle->stats.totalWait += wait;
+        if(wait > handle->stats.maxWait)
+            handle->stats.maxWait = wait;
+    }
+    if(inherited)
+        handle->stats.inheritCount++;
+    return true;
+}
+
+static bool profiledGive(os_mutexHandle_t handle)
+{
+    uint32_t hold = os_timerGetCycles() - handle->lockedAt;
+    if(handle->stats.owner != xTaskGetCurrentTaskHandle())
+        return false;
+    if(hold > handle->stats.maxHold)
+        handle->stats.maxHold = hold;
+    handle->stats.owner = NULL;
+    return xSemaphoreGive(handle->sem);
+}
+
+os_mutexHandle_t os_mutexNew(void)
+{
+    os_mutexHandle_t handle = calloc(1, sizeof(struct os_mutex));
+    if(!handle)
+        return NULL;
+    handle->sem = xSemaphoreCreateMutex();
+    if(!handle->sem) {
+        free(handle);
+        return NULL;
+    }
+    os_timerCycleInit();
+    taskENTER_CRITICAL();
+    handle->next = mutexList;
+    mutexList = handle;
+    taskEXIT_CRITICAL();
+    return handle;
+}
+
+void os_mutexDelete(os_mutexHandle_t handle)
+{
+    os_mutexHandle_t *it;
+    taskENTER_CRITICAL();
+    for(it = &mutexList; *it; it = &(*it)->next) {
+        if(*it == handle) {
+            *it = handle->next;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    vSemaphoreDelete(handle->sem);
+    free(handle);
+}
+
+void os_mutexGetStats(os_mutexHandle_t handle, os_mutexStats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = handle->stats;
+    taskEXIT_CRITICAL();
+}
+
+void os_mutexResetStats(os_mutexHandle_t handle)
+{
+    taskENTER_CRITICAL();
+    memset(&handle->stats, 0, offsetof(os_mutexStats_t, owner));
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Copy the statistics of the mutex at index in the list. The mutex may be
+ * deleted once the critical section ends, so its address and the name of
+ * its owner are copied as well.
+ */
+static bool mutexStatsAt(size_t index, os_mutexStats_t *stats, void **id,
+        char *owner)
+{
+    os_mutexHandle_t it;
+    taskENTER_CRITICAL();
+    for(it = mutexList; it && index; it = it->next)
+        index--;
+    if(it) {
+        *stats = it->stats;
+        *id = it;
+        strncpy(owner, stats->owner ? pcTaskGetTaskName(stats->owner) : "-",
+                configMAX_TASK_NAME_LEN);
+        owner[configMAX_TASK_NAME_LEN] = '\0';
+    }
+    taskEXIT_CRITICAL();
+    return it != NULL;
+}
+
+void os_mutexDumpStats(os_mutexPrint_t print)
+{
+    char line[128];
+    char owner[configMAX_TASK_NAME_LEN + 1];
+    os_mutexStats_t stats;
+    void *id;
+    size_t index;
+
+    /* Fetch one mutex at a time, print may block */
+    for(index = 0; mutexStatsAt(index, &stats, &id, owner); index++) {
+        snprintf(line, sizeof(line),
+                "mutex %p: locks %lu contended %lu inherit %lu "
+                "wait avg %lu max %lu hold max %lu owner %s",
+                id, (unsigned long)stats.lockCount,
+                (unsigned long)stats.contendedCount,
+                (unsigned long)stats.inheritCount,
+                (unsigned long)(stats.contendedCount ?
+                        stats.totalWait / stats.contendedCount : 0),
+                (unsigned long)stats.maxWait, (unsigned long)stats.maxHold,
+                owner);
+        print(line);
+    }
+}
+#else
+#define mutexSem(handle)            (handle)
+#define mutexTake(handle, timeout)  xSemaphoreTake(handle, timeout)
+#define mutexGive(handle)           xSemaphoreGive(handle)
+
 os_mutexHandle_t os_mutexNew(void)
 {
     return xSemaphoreCreateMutex();
 }
 
+void os_mutexDelete(os_mutexHandle_t handle)
+{
+    vSemaphoreDelete(handle);
+}
+#endif
+
 bool os_mutexLock(os_mutexHandle_t handle)
 {
-    return xSemaphoreTake(handle, portMAX_DELAY);
+    return mutexTake(handle, portMAX_DELAY);
 }
 
 bool os_mutexTryLock(os_mutexHandle_t handle)
 {
-    return xSemaphoreTake(handle, 0);
+    return mutexTake(handle, 0);
 }
 
 bool os_mutexTimedLock(os_mutexHandle_t handle, uint32_t timeout)
 {
-    return xSemaphoreTake(handle, timeout);
+    return mutexTake(handle, timeout);
 }
 
 bool os_mutexIsrLock(os_mutexHandle_t handle)
 {
-    bool hasWoken = false;
-    bool ret = false;
-    ret = xSemaphoreTakeFromISR(handle, (BaseType_t *)&hasWoken);
-    portYIELD_FROM_ISR(hasWoken);
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_mutexLockFromIsr(&ctx, handle);
+    os_isrExit(&ctx);
     return ret;
 }
 
+bool os_mutexLockFromIsr(os_isrCtx_t *ctx, os_mutexHandle_t handle)
+{
+    return xSemaphoreTakeFromISR(mutexSem(handle), &ctx->woken);
+}
+
 void os_mutexUnlock(os_mutexHandle_t handle)
 {
-    (void)xSemaphoreGive(handle);
+    (void)mutexGive(handle);
 }
 
 bool os_mutexIsrUnLock(os_mutexHandle_t handle)
 {
-    bool hasWoken = false;
-    bool ret = false;
-    ret = xSemaphoreGiveFromISR(handle, (BaseType_t *)&hasWoken);
-    portYIELD_FROM_ISR(hasWoken);
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_mutexUnlockFromIsr(&ctx, handle);
+    os_isrExit(&ctx);
     return ret;
 }
 
-void os_mutexDelete(os_mutexHandle_t handle)
+bool os_mutexUnlockFromIsr(os_isrCtx_t *ctx, os_mutexHandle_t handle)
+{
+    return xSemaphoreGiveFromISR(mutexSem(handle), &ctx->woken);
+}
+
+os_mutexRecursiveHandle_t os_mutexNewRecursive(void)
+{
+    return xSemaphoreCreateRecursiveMutex();
+}
+
+bool os_mutexRecursiveLock(os_mutexRecursiveHandle_t handle)
+{
+    assertNotIsr();
+    return xSemaphoreTakeRecursive(handle, portMAX_DELAY);
+}
+
+bool os_mutexRecursiveTryLock(os_mutexRecursiveHandle_t handle)
+{
+    assertNotIsr();
+    return xSemaphoreTakeRecursive(handle, 0);
+}
+
+bool os_mutexRecursiveTimedLock(os_mutexRecursiveHandle_t handle,
+        uint32_t timeout)
+{
+    assertNotIsr();
+    return xSemaphoreTakeRecursive(handle, timeout);
+}
+
+bool os_mutexRecursiveUnlock(os_mutexRecursiveHandle_t handle)
+{
+    assertNotIsr();
+    return xSemaphoreGiveRecursive(handle);
+}
+
+struct os_mutexCeiling {
+    SemaphoreHandle_t sem;
+    UBaseType_t ceiling;
+    UBaseType_t savedPrio;
+    TaskHandle_t owner;
+};
+
+/*
+ * The priority the caller runs at without any priority inheritance.
+ * uxTaskPriorityGet returns the inherited priority while the caller holds a
+ * normal mutex, restoring that would keep it after the mutex is released.
+ */
+static UBaseType_t basePriority(void)
+{
+    TaskStatus_t status;
+    vTaskGetInfo(NULL, &status, pdFALSE, eRunning);
+    return status.uxBasePriority;
+}
+
+static bool ceilingTake(os_mutexCeilingHandle_t handle, TickType_t timeout)
+{
+    UBaseType_t prio;
+    assertNotIsr();
+    prio = basePriority();
+    configASSERT(prio <= handle->ceiling);
+    /*
+     * Raise before taking, so the holder can not be preempted by any other
+     * user of the mutex. Setting the priority changes the base priority, an
+     * inherited priority above the ceiling stays in effect.
+     */
+    if(prio < handle->ceiling)
+        vTaskPrioritySet(NULL, handle->ceiling);
+    if(!xSemaphoreTake(handle->sem, timeout)) {
+        vTaskPrioritySet(NULL, prio);
+        return false;
+    }
+    handle->savedPrio = prio;
+    handle->owner = xTaskGetCurrentTaskHandle();
+    return true;
+}
+
+os_mutexCeilingHandle_t os_mutexNewCeiling(os_threadPriorities_t ceilingPrio)
+{
+    os_mutexCeilingHandle_t handle = calloc(1,
+            sizeof(struct os_mutexCeiling));
+    if(!handle)
+        return NULL;
+    /* A plain semaphore, inheritance would only get in the way */
+    handle->sem = xSemaphoreCreateBinary();
+    if(!handle->sem) {
+        free(handle);
+        return NULL;
+    }
+    handle->ceiling = os_threadKernelPriority(ceilingPrio);
+    (void)xSemaphoreGive(handle->sem);
+    return handle;
+}
+
+bool os_mutexCeilingLock(os_mutexCeilingHandle_t handle)
+{
+    return ceilingTake(handle, portMAX_DELAY);
+}
+
+bool os_mutexCeilingTryLock(os_mutexCeilingHandle_t handle)
+{
+    return ceilingTake(handle, 0);
+}
+
+bool os_mutexCeilingTimedLock(os_mutexCeilingHandle_t handle,
+        uint32_t timeout)
+{
+    return ceilingTake(handle, timeout);
+}
+
+void os_mutexCeilingUnlock(os_mutexCeilingHandle_t handle)
+{
+    UBaseType_t prio = handle->savedPrio;
+    assertNotIsr();
+    configASSERT(handle->owner == xTaskGetCurrentTaskHandle());
+    handle->owner = NULL;
+    (void)xSemaphoreGive(handle->sem);
+    vTaskPrioritySet(NULL, prio);
+}
+
+void os_mutexCeilingDelete(os_mutexCeilingHandle_t handle)
+{
+    vSemaphoreDelete(handle->sem);
+    free(handle);
+}
+
+void os_mutexRecursiveDelete(os_mutexRecursiveHandle_t handle)
 {
     vSemaphoreDelete(handle);
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_ringbuf.h"
+#include "os_atomic.h"
+#include "os_semaphore.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if (configTICK_RATE_HZ != 1000)
+#define msToTicks(a)    (a / portTICK_PERIOD_MS)
+#else
+#define msToTicks(a)    a
+#endif
+
+/*
+ * head and tail run freely and wrap at 2^32, the index into the buffer is
+ * taken with the mask. The producer only writes head and the consumer only
+ * writes tail, release/acquire ordering makes the elements visible before
+ * the index that publishes them.
+ */
+struct os_ringbuf {
+    os_atomic32_t head;
+    os_atomic32_t tail;
+    os_atomic8_t waiting;
+    uint32_t mask;
+    uint32_t watermark;
+    size_t elemSize;
+    os_semHandle_t wake;
+    uint8_t *buffer;
+};
+
+#define elemAt(handle, index) \
+    ((handle)->buffer + ((index) & (handle)->mask) * (handle)->elemSize)
+
+/*
+ * Returns true if the consumer has to be woken. The waiting flag is cleared
+ * here, so a commit wakes the consumer at most once.
+ */
+static bool commit(os_ringbufHandle_t handle, uint32_t count)
+{
+    uint32_t head = os_atomicLoad32(&handle->head, OS_ATOMIC_RELAXED) + count;
+    uint32_t tail;
+    os_atomicStore32(&handle->head, head, OS_ATOMIC_SEQ_CST);
+    if(!os_atomicLoad8(&handle->waiting, OS_ATOMIC_SEQ_CST))
+        return false;
+    tail = os_atomicLoad32(&handle->tail, OS_ATOMIC_ACQUIRE);
+    if(head - tail < handle->watermark)
+        return false;
+    return os_atomicExchange8(&handle->waiting, 0, OS_ATOMIC_ACQ_REL);
+}
+
+os_ringbufHandle_t os_ringbufNew(os_ringbufConfig_t *conf)
+{
+    os_ringbufHandle_t handle;
+    os_semConfig_t semConf = {
+        .binary = true,
+        .owner = conf->consumer
+    };
+    if(!conf->capacity || (conf->capacity & (conf->capacity - 1)) ||
+            !conf->elemSize || conf->watermark > conf->capacity)
+        return NULL;
+    handle = calloc(1, sizeof(struct os_ringbuf)
+            + conf->capacity * conf->elemSize);
+    if(!handle)
+        return NULL;
+    handle->wake = os_semNew(&semConf);
+    if(!handle->wake) {
+        free(handle);
+        return NULL;
+    }
+    handle->mask = conf->capacity - 1;
+    handle->watermark = conf->watermark ? conf->watermark : 1;
+    handle->elemSize = conf->elemSize;
+    handle->buffer = (uint8_t *)(handle + 1);
+    return handle;
+}
+
+uint32_t os_ringbufReserve(os_ringbufHandle_t handle, void **data,
+        uint32_t count)
+{
+    uint32_t head = os_atomicLoad32(&handle->head, OS_ATOMIC_RELAXED);
+    uint32_t tail = os_atomicLoad32(&handle->tail, OS_ATOMIC_ACQUIRE);
+    uint32_t space = handle->mask + 1 - (head - tail);
+    uint32_t toEnd = handle->mask + 1 - (head & handle->mask);
+    if(count > space)
+        count = space;
+    if(count > toEnd)
+        count = toEnd;
+    *data = elemAt(handle, head);
+    return count;
+}
+
+void os_ringbufCommit(os_ringbufHandle_t handle, uint32_t count)
+{
+    if(commit(handle, count))
+        os_semPost(handle->wake);
+}
+
+void os_ringbufIsrCommit(os_ringbufHandle_t handle, uint32_t count)
+{
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    os_ringbufCommitFromIsr(&ctx, handle, count);
+    os_isrExit(&ctx);
+}
+
+void os_ringbufCommitFromIsr(os_isrCtx_t *ctx, os_ringbufHandle_t handle,
+        uint32_t count)
+{
+    if(commit(handle, count))
+        (void)os_semPostFromIsr(ctx, handle->wake);
+}
+
+uint32_t os_ringbufPeek(os_ringbufHandle_t handle, const void **data)
+{
+    uint32_t tail = os_atomicLoad32(&handle->tail, OS_ATOMIC_RELAXED);
+    uint32_t head = os_atomicLoad32(&handle->head, OS_ATOMIC_ACQUIRE);
+    uint32_t count = head - tail;
+    uint32_t toEnd = handle->mask + 1 - (tail & handle->mask);
+    *data = elemAt(handle, tail);
+    return count < toEnd ? count : toEnd;
+}
+
+void os_ringbufRelease(os_ringbufHandle_t handle, uint32_t count)
+{
+    uint32_t tail = os_atomicLoad32(&handle->tail, OS_ATOMIC_RELAXED);
+    os_atomicStore32(&handle->tail, tail + count, OS_ATOMIC_RELEASE);
+}
+
+bool os_ringbufWait(os_ringbufHandle_t handle, uint32_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = msToTicks(timeout);
+    TickType_t elapsed;
+
+    while(1) {
+        /*
+         * Announce the wait before checking, a commit after the check then
+         * sees the flag and posts.
+         */
+        os_atomicStore8(&handle->waiting, 1, OS_ATOMIC_SEQ_CST);
+        if(os_ringbufCount(handle) >= handle->watermark)
+            break;
+        elapsed = xTaskGetTickCount() - start;
+        if(ticks != portMAX_DELAY && elapsed >= ticks)
+            break;
+        /* A stale post only causes one more check */
+        (void)os_semTimedWait(handle->wake, ticks == portMAX_DELAY ?
+                portMAX_DELAY : ticks - elapsed);
+    }
+    os_atomicStore8(&handle->waiting, 0, OS_ATOMIC_RELAXED);
+    return os_ringbufCount(handle) >= handle->watermark;
+}
+
+uint32_t os_ringbufCount(os_ringbufHandle_t handle)
+{
+    return os_atomicLoad32(&handle->head, OS_ATOMIC_ACQUIRE)
+            - os_atomicLoad32(&handle->tail, OS_ATOMIC_RELAXED);
+}
+
+void os_ringbufDelete(os_ringbufHandle_t handle)
+{
+    os_semDelete(handle->wake);
+    free(handle);
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_rwlock.h"
+#include "os_semaphore.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if (configTICK_RATE_HZ != 1000)
+#define msToTicks(a)    (a / portTICK_PERIOD_MS)
+#else
+#define msToTicks(a)    a
+#endif
+
+#define READ_WAKE_MAX   255
+
+/*
+ * The state is guarded by a critical section. The semaphores only wake up
+ * waiters, which then check the state again. A wake up that is not needed
+ * anymore, for example because the waiter timed out, leaves a token behind
+ * that causes at most one extra check.
+ */
+struct os_rwlock {
+    os_semHandle_t readSem;
+    os_semHandle_t writeSem;
+    uint16_t readers;
+    uint16_t waitingReaders;
+    uint16_t waitingWriters;
+    bool writer;
+};
+
+static TickType_t remainingTicks(TickType_t start, TickType_t timeout)
+{
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if(timeout == portMAX_DELAY)
+        return portMAX_DELAY;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
+
+static void wakeReaders(os_rwlockHandle_t handle, uint16_t count)
+{
+    while(count--)
+        os_semPost(handle->readSem);
+}
+
+static bool readLock(os_rwlockHandle_t handle, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t remaining;
+    bool waiting = false;
+
+    taskENTER_CRITICAL();
+    while(handle->writer || handle->waitingWriters) {
+        remaining = remainingTicks(start, timeout);
+        if(!remaining) {
+            if(waiting)
+                handle->waitingReaders--;
+            taskEXIT_CRITICAL();
+            return false;
+        }
+        if(!waiting) {
+            handle->waitingReaders++;
+            waiting = true;
+        }
+        taskEXIT_CRITICAL();
+        (void)os_semTimedWait(handle->readSem, remaining);
+        taskENTER_CRITICAL();
+    }
+    if(waiting)
+        handle->waitingReaders--;
+    handle->readers++;
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+static bool writeLock(os_rwlockHandle_t handle, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t remaining;
+    uint16_t readers;
+    bool waiting = false;
+
+    taskENTER_CRITICAL();
+    while(handle->writer || handle->readers) {
+        remaining = remainingTicks(start, timeout);
+        if(!remaining) {
+            readers = 0;
+            if(waiting) {
+                /* Readers held back for this writer may go now */
+                handle->waitingWriters--;
+                if(!handle->writer && !handle->waitingWriters)
+                    readers = handle->waitingReaders;
+            }
+            taskEXIT_CRITICAL();
+            wakeReaders(handle, readers);
+            return false;
+        }
+        if(!waiting) {
+            handle->waitingWriters++;
+            waiting = true;
+        }
+        taskEXIT_CRITICAL();
+        (void)os_semTimedWait(handle->writeSem, remaining);
+        taskENTER_CRITICAL();
+    }
+    if(waiting)
+        handle->waitingWriters--;
+    handle->writer = true;
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+os_rwlockHandle_t os_rwlockNew(void)
+{
+    os_semConfig_t readConf = {
+        .initCount = 0,
+        .maxCount = READ_WAKE_MAX,
+        .binary = false
+    };
+    os_semConfig_t writeConf = {
+        .binary = true
+    };
+    os_rwlockHandle_t handle = calloc(1, sizeof(struct os_rwlock));
+    if(!handle)
+        return NULL;
+    handle->readSem = os_semNew(&readConf);
+    handle->writeSem = os_semNew(&writeConf);
+    if(!handle->readSem || !handle->writeSem) {
+        if(handle->readSem)
+            os_semDelete(handle->readSem);
+        if(handle->writeSem)
+            os_semDelete(handle->writeSem);
+        free(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+bool os_rwlockReadLock(os_rwlockHandle_t handle)
+{
+    return readLock(handle, portMAX_DELAY);
+}
+
+bool os_rwlockTryReadLock(os_rwlockHandle_t handle)
+{
+    return readLock(handle, 0);
+}
+
+bool os_rwlockTimedReadLock(os_rwlockHandle_t handle, uint32_t timeout)
+{
+    return readLock(handle, msToTicks(timeout));
+}
+
+void os_rwlockReadUnlock(os_rwlockHandle_t handle)
+{
+    bool wakeWriter;
+    taskENTER_CRITICAL();
+    handle->readers--;
+    wakeWriter = !handle->readers && handle->waitingWriters;
+    taskEXIT_CRITICAL();
+    if(wakeWriter)
+        os_semPost(handle->writeSem);
+}
+
+bool os_rwlockWriteLock(os_rwlockHandle_t handle)
+{
+    return writeLock(handle, portMAX_DELAY);
+}
+
+bool os_rwlockTryWriteLock(os_rwlockHandle_t handle)
+{
+    return writeLock(handle, 0);
+}
+
+bool os_rwlockTimedWriteLock(os_rwlockHandle_t handle, uint32_t timeout)
+{
+    return writeLock(handle, msToTicks(timeout));
+}
+
+void os_rwlockWriteUnlock(os_rwlockHandle_t handle)
+{
+    bool wakeWriter;
+    uint16_t readers = 0;
+    taskENTER_CRITICAL();
+    handle->writer = false;
+    wakeWriter = handle->waitingWriters;
+    if(!wakeWriter)
+        readers = handle->waitingReaders;
+    taskEXIT_CRITICAL();
+    if(wakeWriter)
+        os_semPost(handle->writeSem);
+    else
+        wakeReaders(handle, readers);
+}
+
+void os_rwlockDelete(os_rwlockHandle_t handle)
+{
+    os_semDelete(handle->readSem);
+    os_semDelete(handle->writeSem);
+    free(handle);
+}
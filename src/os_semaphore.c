@@ -20,53 +20,286 @@
 #include "semphr.h"
 #include "task.h"
 
+/*
+ * In direct mode the owner's notification value is the count. A binary
+ * semaphore clears it on take, a counting one decrements it.
+ */
+struct os_sem {
+    SemaphoreHandle_t sem;
+    TaskHandle_t owner;
+    os_threadHandle_t ownerThread;
+    uint32_t maxCount;
+    bool binary;
+};
+
+#define isDirect(handle)    ((handle)->owner != NULL)
+#define assertOwner(handle) \
+    configASSERT((handle)->owner == xTaskGetCurrentTaskHandle())
+
+static bool directTake(os_semHandle_t handle, TickType_t timeout)
+{
+    assertOwner(handle);
+    return ulTaskNotifyTake(handle->binary, timeout) != 0;
+}
+
+static bool semTake(os_semHandle_t handle, TickType_t timeout)
+{
+    if(isDirect(handle))
+        return directTake(handle, timeout);
+    return xSemaphoreTake(handle->sem, timeout);
+}
+
+static TickType_t remainingTicks(TickType_t start, TickType_t timeout)
+{
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if(timeout == portMAX_DELAY)
+        return portMAX_DELAY;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
+
+/*
+ * Take up to count from the notification value in one go. Giving back the
+ * excess is done in the same critical section, so no post from an ISR gets
+ * lost in between.
+ */
+static uint32_t directTakeAvailable(os_semHandle_t handle, uint32_t count)
+{
+    uint32_t available;
+    if(!count)
+        return 0;
+    taskENTER_CRITICAL();
+    available = ulTaskNotifyTake(pdTRUE, 0);
+    if(handle->binary && available) {
+        available = count ? 1 : 0;
+    } else if(available > count) {
+        (void)xTaskNotify(handle->owner, available - count,
+                eSetValueWithOverwrite);
+        available = count;
+    }
+    taskEXIT_CRITICAL();
+    return available;
+}
+
+/*
+ * Add count to the notification value of the owner without dropping posts
+ * that are already pending. Must be called with interrupts masked.
+ */
+static void directAdd(os_semHandle_t handle, uint32_t count)
+{
+    uint32_t value;
+    (void)xTaskNotifyAndQuery(handle->owner, 0, eNoAction, &value);
+    (void)xTaskNotify(handle->owner, value + count, eSetValueWithOverwrite);
+}
+
+static void directAddFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle,
+        uint32_t count)
+{
+    uint32_t value;
+    (void)xTaskNotifyAndQueryFromISR(handle->owner, 0, eNoAction, &value,
+            &ctx->woken);
+    (void)xTaskNotifyFromISR(handle->owner, value + count,
+            eSetValueWithOverwrite, &ctx->woken);
+}
+
+/*
+ * Limit count to the room left in a queue backed semaphore, so a large
+ * count does not keep interrupts masked for gives that fail anyway.
+ */
+static uint32_t queueRoom(os_semHandle_t handle, uint32_t count,
+        UBaseType_t used)
+{
+    uint32_t room = handle->maxCount > used ? handle->maxCount - used : 0;
+    return count < room ? count : room;
+}
+
+static uint32_t semTakeAvailable(os_semHandle_t handle, uint32_t count)
+{
+    uint32_t taken = 0;
+    if(isDirect(handle))
+        return directTakeAvailable(handle, count);
+    while(taken < count && xSemaphoreTake(handle->sem, 0))
+        taken++;
+    return taken;
+}
+
 os_semHandle_t os_semNew(os_semConfig_t *conf)
 {
+    os_semHandle_t handle = calloc(1, sizeof(struct os_sem));
+    if(!handle)
+        return NULL;
+    handle->binary = conf->binary;
+    handle->maxCount = conf->binary ? 1 : conf->maxCount;
+    if(conf->owner) {
+        /* The notification value holds the count of one semaphore only */
+        taskENTER_CRITICAL();
+        configASSERT(!conf->owner->finished && !conf->owner->directSem);
+        if(conf->owner->finished || conf->owner->directSem) {
+            taskEXIT_CRITICAL();
+            free(handle);
+            return NULL;
+        }
+        conf->owner->directSem = true;
+        handle->ownerThread = conf->owner;
+        handle->owner = conf->owner->threadHandle;
+        if(!conf->binary && conf->initCount)
+            directAdd(handle, conf->initCount);
+        taskEXIT_CRITICAL();
+        return handle;
+    }
     if(conf->binary)
-        return xSemaphoreCreateBinary();
+        handle->sem = xSemaphoreCreateBinary();
     else
-        return xSemaphoreCreateCounting(conf->maxCount, conf->initCount);
+        handle->sem = xSemaphoreCreateCounting(conf->maxCount,
+                conf->initCount);
+    if(!handle->sem) {
+        free(handle);
+        return NULL;
+    }
+    return handle;
 }
 
 bool os_semWait(os_semHandle_t handle)
 {
-    return xSemaphoreTake(handle, portMAX_DELAY);
+    return semTake(handle, portMAX_DELAY);
 }
 
 bool os_semTryWait(os_semHandle_t handle)
 {
-    return xSemaphoreTake(handle, 0);
+    return semTake(handle, 0);
 }
 
 bool os_semTimedWait(os_semHandle_t handle, uint32_t timeout)
 {
-    return xSemaphoreTake(handle, timeout);
+    return semTake(handle, timeout);
 }
 
 bool os_semIsrWait(os_semHandle_t handle)
 {
-    bool hasWoken = false;
-    bool ret;
-    ret = xSemaphoreTakeFromISR(handle, (BaseType_t *)&hasWoken);
-    portYIELD_FROM_ISR(hasWoken);
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_semWaitFromIsr(&ctx, handle);
+    os_isrExit(&ctx);
     return ret;
 }
 
+bool os_semWaitFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle)
+{
+    /* Only the owner thread can take a notification */
+    configASSERT(!isDirect(handle));
+    if(isDirect(handle))
+        return false;
+    return xSemaphoreTakeFromISR(handle->sem, &ctx->woken);
+}
+
 void os_semPost(os_semHandle_t handle)
 {
-    (void)xSemaphoreGive(handle);
+    if(isDirect(handle))
+        (void)xTaskNotifyGive(handle->owner);
+    else
+        (void)xSemaphoreGive(handle->sem);
 }
 
 bool os_semIsrPost(os_semHandle_t handle)
 {
-    bool hasWoken = false;
-    bool ret = false;
-    ret = xSemaphoreGiveFromISR(handle, (BaseType_t *)&hasWoken);
-    portYIELD_FROM_ISR(hasWoken);
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_semPostFromIsr(&ctx, handle);
+    os_isrExit(&ctx);
     return ret;
 }
 
+bool os_semPostFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle)
+{
+    if(isDirect(handle)) {
+        vTaskNotifyGiveFromISR(handle->owner, &ctx->woken);
+        return true;
+    }
+    return xSemaphoreGiveFromISR(handle->sem, &ctx->woken);
+}
+
+uint32_t os_semPostN(os_semHandle_t handle, uint32_t count)
+{
+    uint32_t posted = 0;
+    if(handle->binary)
+        count = count ? 1 : 0;
+    if(!count)
+        return 0;
+    /* Woken threads only run once all counts are added */
+    taskENTER_CRITICAL();
+    if(isDirect(handle)) {
+        directAdd(handle, count);
+        posted = count;
+    } else {
+        count = queueRoom(handle, count, uxSemaphoreGetCount(handle->sem));
+        while(posted < count && xSemaphoreGive(handle->sem))
+            posted++;
+    }
+    taskEXIT_CRITICAL();
+    return posted;
+}
+
+uint32_t os_semIsrPostN(os_semHandle_t handle, uint32_t count)
+{
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    uint32_t ret = os_semPostNFromIsr(&ctx, handle, count);
+    os_isrExit(&ctx);
+    return ret;
+}
+
+uint32_t os_semPostNFromIsr(os_isrCtx_t *ctx, os_semHandle_t handle,
+        uint32_t count)
+{
+    uint32_t posted = 0;
+    UBaseType_t mask;
+    if(handle->binary)
+        count = count ? 1 : 0;
+    if(!count)
+        return 0;
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    if(isDirect(handle)) {
+        directAddFromIsr(ctx, handle, count);
+        posted = count;
+    } else {
+        count = queueRoom(handle, count,
+                uxQueueMessagesWaitingFromISR(handle->sem));
+        while(posted < count && xSemaphoreGiveFromISR(handle->sem,
+                &ctx->woken))
+            posted++;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return posted;
+}
+
+uint32_t os_semWaitN(os_semHandle_t handle, uint32_t count)
+{
+    return os_semTimedWaitN(handle, count, portMAX_DELAY);
+}
+
+uint32_t os_semTimedWaitN(os_semHandle_t handle, uint32_t count,
+        uint32_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t remaining;
+    uint32_t taken = 0;
+    if(handle->binary)
+        count = count ? 1 : 0;
+    if(isDirect(handle))
+        assertOwner(handle);
+    while(taken < count) {
+        taken += semTakeAvailable(handle, count - taken);
+        if(taken == count)
+            break;
+        remaining = remainingTicks(start, timeout);
+        if(!remaining || !semTake(handle, remaining))
+            break;
+        taken++;
+    }
+    return taken;
+}
+
 void os_semDelete(os_semHandle_t handle)
 {
-    vSemaphoreDelete(handle);
+    if(isDirect(handle))
+        handle->ownerThread->directSem = false;
+    else
+        vSemaphoreDelete(handle->sem);
+    free(handle);
 }
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_seqlock.h"
+#include <stdint.h>
+#include <string.h>
+#include "nrf.h"
+
+/*
+ * State n lives in buffer n & 1. While state n is published the writer only
+ * touches the other buffer, so buffer n & 1 changes only after state n + 1
+ * is published. A reader whose sequence did not change during the copy
+ * therefore read a complete state.
+ */
+struct os_seqlock {
+    volatile uint32_t sequence;
+    size_t size;
+    uint8_t *buffers[2];
+};
+
+/*
+ * Both buffers start on an 8 byte boundary, so the state can be written in
+ * place even if it holds doubles or 64 bit integers.
+ */
+#define SEQLOCK_ALIGN       8
+#define seqlockAlign(size)  (((size) + SEQLOCK_ALIGN - 1) & ~(SEQLOCK_ALIGN - 1))
+
+os_seqlockHandle_t os_seqlockNew(size_t size)
+{
+    size_t header = seqlockAlign(sizeof(struct os_seqlock));
+    size_t stride = seqlockAlign(size);
+    os_seqlockHandle_t handle;
+    if(stride < size || stride > (SIZE_MAX - header) / 2)
+        return NULL;
+    handle = calloc(1, header + 2 * stride);
+    if(!handle)
+        return NULL;
+    handle->size = size;
+    handle->buffers[0] = (uint8_t *)handle + header;
+    handle->buffers[1] = handle->buffers[0] + stride;
+    return handle;
+}
+
+void os_seqlockWrite(os_seqlockHandle_t handle, const void *data)
+{
+    memcpy(os_seqlockWriteBegin(handle), data, handle->size);
+    os_seqlockWriteEnd(handle);
+}
+
+void *os_seqlockWriteBegin(os_seqlockHandle_t handle)
+{
+    return handle->buffers[(handle->sequence + 1) & 1];
+}
+
+void os_seqlockWriteEnd(os_seqlockHandle_t handle)
+{
+    /* The state must be complete before it is published */
+    __DMB();
+    handle->sequence++;
+}
+
+uint32_t os_seqlockRead(os_seqlockHandle_t handle, void *data)
+{
+    uint32_t sequence;
+    do {
+        sequence = handle->sequence;
+        __DMB();
+        memcpy(data, handle->buffers[sequence & 1], handle->size);
+        __DMB();
+    } while(sequence != handle->sequence);
+    return sequence;
+}
+
+uint32_t os_seqlockGetSequence(os_seqlockHandle_t handle)
+{
+    return handle->sequence;
+}
+
+void os_seqlockDelete(os_seqlockHandle_t handle)
+{
+    free(handle);
+}
@@ -15,49 +15,323 @@
  */
 
 #include "os_thread.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
 #include "FreeRTOS.h"
 #include  "task.h"
 
-struct os_threadHandle {
-    TaskHandle_t threadHandle;
+#if OS_THREAD_STATS
+#include "nrf.h"
+
+/* The RTC counter is 24 bits wide */
+#define STATS_COUNTER_MASK  0x00FFFFFFUL
+#define statsCounter()      (NRF_RTC1->COUNTER)
+#endif
+
+#if (configTICK_RATE_HZ != 1000)
+#define ticksToMs(a)    (a * portTICK_PERIOD_MS)
+#define msToTicks(a)    (a / portTICK_PERIOD_MS)
+#else
+#define ticksToMs(a)    a
+#define msToTicks(a)    a
+#endif
+
+/*
+ * A finished thread may have no task anymore. Its NULL task handle would
+ * make the kernel act on the calling task, so those calls do nothing.
+ */
+#define threadGone(handle)  ((handle) && (handle)->finished)
+
+static const eNotifyAction notifyActions[] = {
+    [THREAD_NOTIFY_SET_BITS] = eSetBits,
+    [THREAD_NOTIFY_INCREMENT] = eIncrement,
+    [THREAD_NOTIFY_OVERWRITE] = eSetValueWithOverwrite,
+    [THREAD_NOTIFY_NO_OVERWRITE] = eSetValueWithoutOverwrite
 };
 
+/* n * (2^(1/n) - 1) in parts per million, rounded down */
+static const uint32_t rmBounds[] = {
+    1000000, 828427, 779763, 756828, 743491,
+    734772, 728626, 724061, 720537, 717734
+};
+#define RM_BOUND_LIMIT  693147  /* ln(2), the bound for large n */
+
+/* Thread local storage slot of the thread handle */
+#define TLS_SELF        0
+#define SCRATCH_ALIGN   8
+#define REPORT_LINE_LEN 112
+#define REPORT_NAME_LEN 24
+
+static os_threadHandle_t threadList;
+
+static void threadFinish(os_threadHandle_t handle)
+{
+    handle->stackFree = uxTaskGetStackHighWaterMark(NULL);
+    handle->finished = true;
+    (void)xSemaphoreGive(handle->joinSem);
+    /*
+     * The task is deleted by os_threadJoin or os_threadDelete. Deleting it
+     * from another task releases the memory right away, instead of leaving
+     * it to the idle task while the handle may already be reused.
+     */
+    while(1)
+        vTaskSuspend(NULL);
+}
+
+static void threadEntry(void *args)
+{
+    os_threadHandle_t handle = args;
+    uint32_t lastWake;
+
+    vTaskSetThreadLocalStoragePointer(NULL, TLS_SELF, handle);
+    if(!handle->period) {
+        handle->callback(handle->args);
+    } else {
+        lastWake = ticksToMs(xTaskGetTickCount());
+        while(1) {
+            handle->callback(handle->args);
+            if(!os_threadDelayUntil(&lastWake, handle->period))
+                handle->overruns++;
+        }
+    }
+    threadFinish(handle);
+}
+
+static void threadInit(os_threadHandle_t handle, os_threadConfig_t *conf,
+        bool isStatic)
+{
+    memset(handle, 0, sizeof(struct os_threadHandle));
+    handle->isStatic = isStatic;
+    handle->name = conf->name;
+    handle->stackSize = conf->stackSize;
+    handle->callback = conf->threadCallback;
+    handle->args = conf->threadArgs;
+    handle->period = conf->period;
+    handle->execTime = conf->execTime;
+    handle->scratch = conf->scratchBuffer;
+    handle->scratchSize = conf->scratchSize;
+    handle->joinSem = xSemaphoreCreateBinaryStatic(&handle->joinBuffer);
+}
+
+static void threadRegister(os_threadHandle_t handle)
+{
+#if OS_THREAD_STATS
+    handle->lastTick = xTaskGetTickCount();
+    vTaskSetApplicationTaskTag(handle->threadHandle,
+            (TaskHookFunction_t)handle);
+#endif
+    taskENTER_CRITICAL();
+    handle->next = threadList;
+    threadList = handle;
+    taskEXIT_CRITICAL();
+}
+
+static void threadUnregister(os_threadHandle_t handle)
+{
+    os_threadHandle_t *it;
+    taskENTER_CRITICAL();
+    for(it = &threadList; *it; it = &(*it)->next) {
+        if(*it == handle) {
+            *it = handle->next;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
 os_threadHandle_t os_threadNew(os_threadConfig_t *conf)
 {
-    os_threadHandle_t handle = calloc(1, sizeof(struct os_threadHandle));
+    os_threadHandle_t handle;
     bool ret;
-    ret = xTaskCreate(conf->threadCallback,
+    if(conf->stackBuffer && conf->storage)
+        return os_threadNewStatic(conf);
+    handle = malloc(sizeof(struct os_threadHandle));
+    if(!handle)
+        return NULL;
+    threadInit(handle, conf, false);
+    if(handle->scratchSize && !handle->scratch) {
+        handle->scratch = malloc(handle->scratchSize);
+        if(!handle->scratch) {
+            free(handle);
+            return NULL;
+        }
+        handle->scratchOwned = true;
+    }
+    ret = xTaskCreate(threadEntry,
             conf->name,
             conf->stackSize,
-            conf->threadArgs,
-            conf->priority,
+            handle,
+            os_threadKernelPriority(conf->priority),
             &handle->threadHandle);
     if(!ret) {
+        if(handle->scratchOwned)
+            free(handle->scratch);
         free(handle);
         return NULL;
     }
+    threadRegister(handle);
     return handle;
 }
 
-void os_startScheduler(void)
+os_threadHandle_t os_threadNewStatic(os_threadConfig_t *conf)
 {
+    os_threadHandle_t handle;
+    if(!conf->stackBuffer || !conf->storage)
+        return NULL;
+    if(conf->scratchSize && !conf->scratchBuffer)
+        return NULL;
+    handle = &conf->storage->handle;
+    threadInit(handle, conf, true);
+    handle->threadHandle = xTaskCreateStatic(threadEntry,
+            conf->name,
+            conf->stackSize,
+            handle,
+            os_threadKernelPriority(conf->priority),
+            conf->stackBuffer,
+            &conf->storage->taskBuffer);
+    if(!handle->threadHandle)
+        return NULL;
+    threadRegister(handle);
+    return handle;
+}
+
+/* Rate monotonic bound for a utilization in parts per million */
+static bool rmBoundHolds(uint64_t utilization, size_t periodic)
+{
+    if(!periodic)
+        return true;
+    if(periodic > sizeof(rmBounds) / sizeof(rmBounds[0]))
+        return utilization <= RM_BOUND_LIMIT;
+    return utilization <= rmBounds[periodic - 1];
+}
+
+/*
+ * Sum of execTime / period over the periodic threads that were created, in
+ * parts per million. Only used before the scheduler runs, so the thread
+ * list can not change.
+ */
+static bool threadsSchedulable(void)
+{
+    os_threadHandle_t it;
+    uint64_t utilization = 0;
+    size_t periodic = 0;
+    for(it = threadList; it; it = it->next) {
+        if(it->finished || !it->period)
+            continue;
+        utilization += (uint64_t)it->execTime * 1000000 / it->period;
+        periodic++;
+    }
+    return rmBoundHolds(utilization, periodic);
+}
+
+bool os_startScheduler(void)
+{
+    bool schedulable = threadsSchedulable();
+    configASSERT(schedulable);
+    if(!schedulable)
+        return false;
     vTaskStartScheduler();
+    return false;
+}
+
+UBaseType_t os_threadKernelPriority(os_threadPriorities_t prio)
+{
+    if(prio >= THREAD_PRIO_COUNT)
+        prio = THREAD_PRIO_HIGH;
+    return (prio * (configMAX_PRIORITIES - 1)) / (THREAD_PRIO_COUNT - 1);
+}
+
+void os_threadSetPriority(os_threadHandle_t handle, os_threadPriorities_t prio)
+{
+    if(threadGone(handle))
+        return;
+    vTaskPrioritySet(handle ? handle->threadHandle : NULL,
+            os_threadKernelPriority(prio));
+}
+
+os_threadPriorities_t os_threadGetPriority(os_threadHandle_t handle)
+{
+    UBaseType_t kernelPrio;
+    os_threadPriorities_t prio = THREAD_PRIO_HIGH;
+    if(threadGone(handle))
+        return THREAD_PRIO_LOW;
+    kernelPrio = uxTaskPriorityGet(handle ? handle->threadHandle : NULL);
+    while(prio > THREAD_PRIO_LOW && os_threadKernelPriority(prio) > kernelPrio)
+        prio--;
+    return prio;
+}
+
+bool os_threadIsSchedulable(os_threadConfig_t *confs[], size_t count)
+{
+    uint64_t utilization = 0;
+    size_t periodic = 0;
+    size_t i;
+    for(i = 0; i < count; i++) {
+        if(!confs[i]->period)
+            continue;
+        utilization += (uint64_t)confs[i]->execTime * 1000000
+                / confs[i]->period;
+        periodic++;
+    }
+    return rmBoundHolds(utilization, periodic);
+}
+
+bool os_threadAssignRmPriorities(os_threadConfig_t *confs[], size_t count)
+{
+    size_t i;
+    size_t j;
+    size_t k;
+    uint32_t shorter;
+    for(i = 0; i < count; i++) {
+        if(!confs[i]->period)
+            continue;
+        /* Rank by the number of distinct shorter periods */
+        shorter = 0;
+        for(j = 0; j < count; j++) {
+            if(confs[j]->period && confs[j]->period < confs[i]->period) {
+                for(k = 0; k < j; k++) {
+                    if(confs[k]->period == confs[j]->period)
+                        break;
+                }
+                if(k == j)
+                    shorter++;
+            }
+        }
+        if(shorter > THREAD_PRIO_HIGH)
+            confs[i]->priority = THREAD_PRIO_LOW;
+        else
+            confs[i]->priority = THREAD_PRIO_HIGH - shorter;
+    }
+    return os_threadIsSchedulable(confs, count);
 }
 
 bool os_threadStop(os_threadHandle_t handle)
 {
-    vTaskDelete(handle);
+    if(handle == os_threadSelf())
+        os_threadExit();
+    if(handle->finished)
+        return false;
+    handle->stackFree = uxTaskGetStackHighWaterMark(handle->threadHandle);
+    vTaskDelete(handle->threadHandle);
+    handle->threadHandle = NULL;
+    handle->finished = true;
+    (void)xSemaphoreGive(handle->joinSem);
     return true;
 }
 
 bool os_threadPause(os_threadHandle_t handle)
 {
+    if(threadGone(handle))
+        return false;
     vTaskSuspend(handle->threadHandle);
     return true;
 }
 
 bool os_threadResume(os_threadHandle_t handle)
 {
+    if(threadGone(handle))
+        return false;
     vTaskResume(handle->threadHandle);
     return true;
 }
@@ -69,33 +343,367 @@ void os_threadWait(void)
 
 void os_threadNotify(os_threadHandle_t handle)
 {
+    if(threadGone(handle))
+        return;
     (void)xTaskNotifyGive(handle->threadHandle);
 }
 
 void os_threadIsrNotify(os_threadHandle_t handle)
 {
-    bool hasWoken = false;
-    vTaskNotifyGiveFromISR(handle->threadHandle, (BaseType_t *)&hasWoken);
-    portYIELD_FROM_ISR(hasWoken);
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    os_threadNotifyFromIsr(&ctx, handle);
+    os_isrExit(&ctx);
+}
+
+void os_threadNotifyFromIsr(os_isrCtx_t *ctx, os_threadHandle_t handle)
+{
+    if(threadGone(handle))
+        return;
+    vTaskNotifyGiveFromISR(handle->threadHandle, &ctx->woken);
+}
+
+bool os_threadDelayUntil(uint32_t *lastWake, uint32_t period)
+{
+    TickType_t wake = msToTicks(*lastWake);
+    bool onTime = (xTaskGetTickCount() - wake) < msToTicks(period);
+    vTaskDelayUntil(&wake, msToTicks(period));
+    *lastWake = ticksToMs(wake);
+    return onTime;
+}
+
+uint32_t os_threadGetOverruns(os_threadHandle_t handle)
+{
+    return handle->overruns;
+}
+
+bool os_threadTimedWait(uint32_t timeout)
+{
+    return ulTaskNotifyTake(true, msToTicks(timeout)) != 0;
+}
+
+bool os_threadWaitValue(uint32_t clearOnEntry, uint32_t clearOnExit,
+        uint32_t *value, uint32_t timeout)
+{
+    return xTaskNotifyWait(clearOnEntry, clearOnExit, value,
+            msToTicks(timeout));
+}
+
+bool os_threadNotifyValue(os_threadHandle_t handle, uint32_t value,
+        os_threadNotifyMode_t mode)
+{
+    configASSERT(mode < sizeof(notifyActions) / sizeof(notifyActions[0]));
+    configASSERT(mode != THREAD_NOTIFY_SET_BITS ||
+            !(value & THREAD_NOTIFY_RESERVED_BIT));
+    if(threadGone(handle))
+        return false;
+    return xTaskNotify(handle->threadHandle, value, notifyActions[mode]);
+}
+
+bool os_threadIsrNotifyValue(os_threadHandle_t handle, uint32_t value,
+        os_threadNotifyMode_t mode)
+{
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_threadNotifyValueFromIsr(&ctx, handle, value, mode);
+    os_isrExit(&ctx);
+    return ret;
+}
+
+bool os_threadNotifyValueFromIsr(os_isrCtx_t *ctx, os_threadHandle_t handle,
+        uint32_t value, os_threadNotifyMode_t mode)
+{
+    configASSERT(mode < sizeof(notifyActions) / sizeof(notifyActions[0]));
+    configASSERT(mode != THREAD_NOTIFY_SET_BITS ||
+            !(value & THREAD_NOTIFY_RESERVED_BIT));
+    if(threadGone(handle))
+        return false;
+    return xTaskNotifyFromISR(handle->threadHandle, value, notifyActions[mode],
+            &ctx->woken);
 }
 
 bool os_threadIsRunning(os_threadHandle_t handle)
 {
-    return (eTaskGetState(handle->threadHandle) == eRunning);
+    return !handle->finished &&
+            (eTaskGetState(handle->threadHandle) == eRunning);
 }
 
 bool os_threadIsPaused(os_threadHandle_t handle)
 {
-    return (eTaskGetState(handle->threadHandle) == eSuspended);
+    return !handle->finished &&
+            (eTaskGetState(handle->threadHandle) == eSuspended);
 }
 
-void os_threadExit(os_threadHandle_t handle)
+void os_threadExit(void)
 {
-    vTaskDelete(handle->threadHandle);
+    os_threadHandle_t handle = os_threadSelf();
+    if(!handle)
+        vTaskDelete(NULL);
+    threadFinish(handle);
+}
+
+bool os_threadJoin(os_threadHandle_t handle, uint32_t timeout)
+{
+    if(!xSemaphoreTake(handle->joinSem, msToTicks(timeout)))
+        return false;
+    os_threadDelete(handle);
+    return true;
+}
+
+bool os_threadIsFinished(os_threadHandle_t handle)
+{
+    return handle->finished;
+}
+
+void os_threadGetStats(os_threadHandle_t handle, os_threadStats_t *stats)
+{
+#if OS_THREAD_STATS
+    uint32_t runTime;
+    uint32_t window;
+    TickType_t now;
+
+    taskENTER_CRITICAL();
+    runTime = handle->runTime;
+    if(handle->threadHandle == xTaskGetCurrentTaskHandle())
+        runTime += (statsCounter() - handle->switchedIn) & STATS_COUNTER_MASK;
+    now = xTaskGetTickCount();
+    taskEXIT_CRITICAL();
+
+    window = (uint64_t)(now - handle->lastTick) * OS_THREAD_STATS_HZ
+            / configTICK_RATE_HZ;
+    if(window)
+        stats->cpuPercent = (uint64_t)(runTime - handle->lastRunTime) * 100
+                / window;
+    else
+        stats->cpuPercent = 0;
+    handle->lastRunTime = runTime;
+    handle->lastTick = now;
+    stats->runTime = runTime;
+    stats->switchCount = handle->switchCount;
+#else
+    stats->runTime = 0;
+    stats->cpuPercent = 0;
+    stats->switchCount = 0;
+#endif
+    stats->name = handle->name;
+    stats->stackSize = handle->stackSize;
+    if(handle->finished)
+        stats->stackFree = handle->stackFree;
+    else
+        stats->stackFree = uxTaskGetStackHighWaterMark(handle->threadHandle);
+}
+
+size_t os_threadGetAllStats(os_threadStats_t *stats, size_t maxCount)
+{
+    os_threadHandle_t it;
+    size_t count = 0;
+    vTaskSuspendAll();
+    for(it = threadList; it && count < maxCount; it = it->next)
+        os_threadGetStats(it, &stats[count++]);
+    (void)xTaskResumeAll();
+    return count;
+}
+
+#if OS_THREAD_STATS
+void os_threadStatsSwitchedIn(void *tag)
+{
+    os_threadHandle_t handle = tag;
+    if(handle) {
+        handle->switchedIn = statsCounter();
+        handle->switchCount++;
+    }
+}
+
+void os_threadStatsSwitchedOut(void *tag)
+{
+    os_threadHandle_t handle = tag;
+    if(handle)
+        handle->runTime += (statsCounter() - handle->switchedIn)
+                & STATS_COUNTER_MASK;
+}
+#endif
+
+static bool threadStatsAt(size_t index, os_threadStats_t *stats)
+{
+    os_threadHandle_t it;
+    vTaskSuspendAll();
+    for(it = threadList; it && index; it = it->next)
+        index--;
+    if(it)
+        os_threadGetStats(it, stats);
+    (void)xTaskResumeAll();
+    return it != NULL;
+}
+
+/* Thread name as it appears in the define, upper case identifier characters */
+static void reportName(char *name, const char *threadName)
+{
+    size_t i;
+    for(i = 0; threadName && threadName[i] && i < REPORT_NAME_LEN - 1; i++)
+        name[i] = isalnum((unsigned char)threadName[i]) ?
+                toupper((unsigned char)threadName[i]) : '_';
+    name[i] = '\0';
+}
+
+static uint32_t recommendedStack(os_threadStats_t *stats,
+        uint8_t marginPercent)
+{
+    uint32_t used = stats->stackSize - stats->stackFree;
+    uint32_t recommended = used + (used * marginPercent + 99) / 100;
+    if(recommended < configMINIMAL_STACK_SIZE)
+        recommended = configMINIMAL_STACK_SIZE;
+    return recommended;
+}
+
+/*
+ * Threads that share a name, like the workers of a work queue, share one
+ * define with the largest recommendation among them. The define is emitted
+ * at the first thread with the name in the list.
+ */
+static void reportThread(os_threadPrint_t print, const char *name,
+        size_t index, uint8_t marginPercent)
+{
+    char line[REPORT_LINE_LEN];
+    char other[REPORT_NAME_LEN];
+    os_threadStats_t stats;
+    os_threadStats_t worst;
+    uint32_t recommended = 0;
+    uint32_t count = 0;
+
+    for(; threadStatsAt(index, &stats); index++) {
+        reportName(other, stats.name);
+        if(strcmp(name, other))
+            continue;
+        if(!count++ || recommendedStack(&stats, marginPercent) > recommended) {
+            worst = stats;
+            recommended = recommendedStack(&stats, marginPercent);
+        }
+    }
+    if(!count)
+        return;
+
+    snprintf(line, sizeof(line),
+            "#define STACK_SIZE_%s %lu /* used %lu of %lu words%s, "
+            "%lu thread%s */",
+            name, (unsigned long)recommended,
+            (unsigned long)(worst.stackSize - worst.stackFree),
+            (unsigned long)worst.stackSize,
+            (worst.stackSize * 100 > recommended *
+                    (100 + OS_STACK_OVERSIZE_PERCENT)) ? ", oversized" : "",
+            (unsigned long)count, count > 1 ? "s" : "");
+    print(line);
+}
+
+static bool nameReportedBefore(const char *name, size_t index)
+{
+    char other[REPORT_NAME_LEN];
+    os_threadStats_t stats;
+    size_t i;
+    for(i = 0; i < index && threadStatsAt(i, &stats); i++) {
+        reportName(other, stats.name);
+        if(!strcmp(name, other))
+            return true;
+    }
+    return false;
+}
+
+void os_threadStackReport(os_threadPrint_t print, uint8_t marginPercent)
+{
+    char line[REPORT_LINE_LEN];
+    char name[REPORT_NAME_LEN];
+    os_threadStats_t stats;
+    size_t index = 0;
+
+    snprintf(line, sizeof(line),
+            "/* Generated by os_threadStackReport, margin %u%% */",
+            marginPercent);
+    print(line);
+    print("#ifndef OS_STACK_SIZES_H");
+    print("#define OS_STACK_SIZES_H");
+    /* Fetch one thread at a time, print may block */
+    for(; threadStatsAt(index, &stats); index++) {
+        reportName(name, stats.name);
+        if(!nameReportedBefore(name, index))
+            reportThread(print, name, index, marginPercent);
+    }
+    print("#endif /* OS_STACK_SIZES_H */");
+}
+
+os_threadHandle_t os_threadSelf(void)
+{
+    return pvTaskGetThreadLocalStoragePointer(NULL, TLS_SELF);
+}
+
+void os_threadSetLocal(uint8_t index, void *ptr)
+{
+    configASSERT(index < OS_THREAD_LOCAL_COUNT);
+    vTaskSetThreadLocalStoragePointer(NULL, index + 1, ptr);
+}
+
+void *os_threadGetLocal(uint8_t index)
+{
+    configASSERT(index < OS_THREAD_LOCAL_COUNT);
+    return pvTaskGetThreadLocalStoragePointer(NULL, index + 1);
+}
+
+void *os_threadScratchAlloc(size_t size)
+{
+    os_threadHandle_t handle = os_threadSelf();
+    uint32_t left;
+    void *ptr;
+    if(!handle)
+        return NULL;
+    /* Check before rounding up, a huge size would wrap to 0 */
+    left = handle->scratchSize - handle->scratchUsed;
+    if(size > left)
+        return NULL;
+    size = (size + SCRATCH_ALIGN - 1) & ~(SCRATCH_ALIGN - 1);
+    if(size > left)
+        return NULL;
+    ptr = handle->scratch + handle->scratchUsed;
+    handle->scratchUsed += size;
+    return ptr;
+}
+
+void os_threadScratchReset(void)
+{
+    os_threadHandle_t handle = os_threadSelf();
+    if(handle)
+        handle->scratchUsed = 0;
 }
 
 void os_threadDelete(os_threadHandle_t handle)
 {
-    vTaskDelete(handle->threadHandle);
-    free(handle);
+    configASSERT(handle != os_threadSelf());
+    threadUnregister(handle);
+    if(handle->threadHandle)
+        vTaskDelete(handle->threadHandle);
+    if(handle->scratchOwned)
+        free(handle->scratch);
+    if(!handle->isStatic)
+        free(handle);
+}
+
+/*
+ * With static allocation enabled, the kernel asks the application for the
+ * memory of the idle and timer tasks. Keep them off the heap as well.
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **taskBuffer,
+        StackType_t **stackBuffer, uint32_t *stackSize)
+{
+    static StaticTask_t idleTaskBuffer;
+    static OS_THREAD_STACK_DEFINE(idleStack, configMINIMAL_STACK_SIZE);
+
+    *taskBuffer = &idleTaskBuffer;
+    *stackBuffer = idleStack;
+    *stackSize = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **taskBuffer,
+        StackType_t **stackBuffer, uint32_t *stackSize)
+{
+    static StaticTask_t timerTaskBuffer;
+    static OS_THREAD_STACK_DEFINE(timerStack, configTIMER_TASK_STACK_DEPTH);
+
+    *taskBuffer = &timerTaskBuffer;
+    *stackBuffer = timerStack;
+    *stackSize = configTIMER_TASK_STACK_DEPTH;
 }
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "os_workqueue.h"
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+
+typedef struct {
+    os_workCallback_t callback;
+    void *args;
+    TickType_t submitted;
+} os_workJob_t;
+
+struct os_workqueue {
+    QueueHandle_t queue;
+    os_threadHandle_t *workers;
+    os_workqueueStats_t stats;
+};
+
+static void workerThread(void *args)
+{
+    os_workqueueHandle_t handle = args;
+    os_workJob_t job;
+    uint32_t latency;
+
+    while(1) {
+        if(!xQueueReceive(handle->queue, &job, portMAX_DELAY))
+            continue;
+        latency = (xTaskGetTickCount() - job.submitted) * portTICK_PERIOD_MS;
+        taskENTER_CRITICAL();
+        handle->stats.totalLatency += latency;
+        if(latency > handle->stats.maxLatency)
+            handle->stats.maxLatency = latency;
+        taskEXIT_CRITICAL();
+        job.callback(job.args);
+        taskENTER_CRITICAL();
+        handle->stats.completed++;
+        taskEXIT_CRITICAL();
+    }
+}
+
+static void updateDepth(os_workqueueHandle_t handle, uint16_t depth)
+{
+    handle->stats.submitted++;
+    if(depth > handle->stats.maxDepth)
+        handle->stats.maxDepth = depth;
+}
+
+os_workqueueHandle_t os_workqueueNew(os_workqueueConfig_t *conf)
+{
+    uint8_t i;
+    os_workqueueHandle_t handle = calloc(1, sizeof(struct os_workqueue));
+    if(!handle)
+        return NULL;
+    handle->queue = xQueueCreate(conf->queueLength, sizeof(os_workJob_t));
+    if(!handle->queue) {
+        free(handle);
+        return NULL;
+    }
+    handle->workers = calloc(conf->workerCount, sizeof(os_threadHandle_t));
+    if(!handle->workers) {
+        vQueueDelete(handle->queue);
+        free(handle);
+        return NULL;
+    }
+
+    os_threadConfig_t threadConf = {
+        .name = conf->name,
+        .threadCallback = workerThread,
+        .threadArgs = handle,
+        .stackSize = conf->stackSize,
+        .priority = conf->priority
+    };
+    for(i = 0; i < conf->workerCount; i++) {
+        handle->workers[i] = os_threadNew(&threadConf);
+        if(!handle->workers[i]) {
+            /* The workers started so far block on the empty queue */
+            while(i--)
+                os_threadDelete(handle->workers[i]);
+            free(handle->workers);
+            vQueueDelete(handle->queue);
+            free(handle);
+            return NULL;
+        }
+    }
+    return handle;
+}
+
+bool os_workSubmit(os_workqueueHandle_t handle, os_workCallback_t callback,
+        void *args)
+{
+    os_workJob_t job = {
+        .callback = callback,
+        .args = args,
+        .submitted = xTaskGetTickCount()
+    };
+    bool ret;
+    taskENTER_CRITICAL();
+    ret = xQueueSend(handle->queue, &job, 0);
+    if(ret)
+        updateDepth(handle, uxQueueMessagesWaiting(handle->queue));
+    else
+        handle->stats.dropped++;
+    taskEXIT_CRITICAL();
+    return ret;
+}
+
+bool os_workIsrSubmit(os_workqueueHandle_t handle, os_workCallback_t callback,
+        void *args)
+{
+    os_isrCtx_t ctx = OS_ISR_CTX_INIT;
+    bool ret = os_workSubmitFromIsr(&ctx, handle, callback, args);
+    os_isrExit(&ctx);
+    return ret;
+}
+
+bool os_workSubmitFromIsr(os_isrCtx_t *ctx, os_workqueueHandle_t handle,
+        os_workCallback_t callback, void *args)
+{
+    os_workJob_t job = {
+        .callback = callback,
+        .args = args,
+        .submitted = xTaskGetTickCountFromISR()
+    };
+    UBaseType_t mask;
+    bool ret;
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    ret = xQueueSendFromISR(handle->queue, &job, &ctx->woken);
+    if(ret)
+        updateDepth(handle, uxQueueMessagesWaitingFromISR(handle->queue));
+    else
+        handle->stats.dropped++;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return ret;
+}
+
+void os_workqueueGetStats(os_workqueueHandle_t handle,
+        os_workqueueStats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = handle->stats;
+    stats->depth = uxQueueMessagesWaiting(handle->queue);
+    taskEXIT_CRITICAL();
+}
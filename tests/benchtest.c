@@ -0,0 +1,368 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Synchronisation benchmarks. Build with TEST=bench.
+ * The results are stored in benchResults, read them with the debugger once
+ * LED 1 turns on. LED 0 blinks while the benchmarks run.
+ * The tree has no host build, so these run on the target instead of as the
+ * host benchmarks the rwlock, seqlock and ring buffer were specified with.
+ *
+ * FreeRTOS heap: five threads of BENCH_STACK_SIZE take about 770 bytes each
+ * (640 bytes of stack, the task control block and two heap headers), about
+ * 3.9 KB. The idle and timer tasks and the timer queue add about 1.4 KB. The
+ * mutex, the two rwlock semaphores, the semaphore of cycleRing and the one
+ * in semCycles are about 90 bytes each. That is about 5.7 KB, more than the
+ * default 4 KB heap, so the Makefile raises it to 12 KB for TEST=bench.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "bsp.h"
+#include "pca10040.h"
+#include "nrf52.h"
+#include "nordic_common.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_clock.h"
+#include "sdk_errors.h"
+#include "app_error.h"
+
+#include "os_thread.h"
+#include "os_timer.h"
+#include "os_mutex.h"
+#include "os_rwlock.h"
+#include "os_critical.h"
+#include "os_seqlock.h"
+#include "os_semaphore.h"
+#include "os_ringbuf.h"
+
+#define DEAD_BEEF 0xDEADBEEF
+#define BENCH_STACK_SIZE    (configMINIMAL_STACK_SIZE + 100)
+#define BENCH_TIME          1000
+#define BENCH_READERS       3
+#define TABLE_SIZE          32
+#define CYCLE_RUNS          1000
+#define RING_CAPACITY       256
+#define RING_BATCH          16
+
+typedef enum {
+    BENCH_IDLE,
+    BENCH_MUTEX_READ,
+    BENCH_RWLOCK_READ,
+    BENCH_CRITICAL,
+    BENCH_MUTEX,
+    BENCH_SEQLOCK
+} benchMode_t;
+
+typedef struct {
+    uint32_t mutexReads;        /**<Table reads per BENCH_TIME with os_mutex*/
+    uint32_t rwlockReads;       /**<Table reads per BENCH_TIME with os_rwlock*/
+    uint32_t loopCycles;        /**<Cycles of a bare counter update*/
+    uint32_t criticalCycles;    /**<Cycles of an update in os_critical*/
+    uint32_t mutexCycles;       /**<Cycles of an update under os_mutex*/
+    uint32_t seqlockReadCycles; /**<Cycles to read the table with os_seqlock*/
+    uint32_t mutexReadCycles;   /**<Cycles to copy the table under os_mutex*/
+    uint32_t semQueueCycles;    /**<Cycles of a post and wait, queue backend*/
+    uint32_t semDirectCycles;   /**<Cycles of a post and wait, direct backend*/
+    uint32_t ringSampleCycles;  /**<Cycles per sample, one sample at a time*/
+    uint32_t ringBatchCycles;   /**<Cycles per sample, RING_BATCH at a time*/
+    uint32_t ringSamplesPerSec; /**<Samples per second from thread to thread*/
+} benchResults_t;
+
+volatile benchResults_t benchResults;
+
+static volatile benchMode_t benchMode = BENCH_IDLE;
+static volatile uint32_t readCount[BENCH_READERS];
+static uint32_t table[TABLE_SIZE];
+static os_mutexHandle_t tableMutex;
+static os_rwlockHandle_t tableLock;
+static os_seqlockHandle_t tableSeqlock;
+static os_ringbufHandle_t ring;
+static os_ringbufHandle_t cycleRing;
+static volatile uint32_t ringConsumed;
+
+/*
+ * Copy the table and yield halfway, like a reader that gets preempted while
+ * it holds the lock.
+ */
+static void readTable(uint32_t *copy)
+{
+    memcpy(copy, table, sizeof(table) / 2);
+    taskYIELD();
+    memcpy(copy + TABLE_SIZE / 2, table + TABLE_SIZE / 2, sizeof(table) / 2);
+}
+
+static void readerThread(void *args)
+{
+    uint32_t index = (uint32_t)args;
+    uint32_t copy[TABLE_SIZE];
+    while(1) {
+        switch(benchMode) {
+            case BENCH_MUTEX_READ:
+                os_mutexLock(tableMutex);
+                readTable(copy);
+                os_mutexUnlock(tableMutex);
+                readCount[index]++;
+                break;
+            case BENCH_RWLOCK_READ:
+                os_rwlockReadLock(tableLock);
+                readTable(copy);
+                os_rwlockReadUnlock(tableLock);
+                readCount[index]++;
+                break;
+            default:
+                os_timerDelay(10);
+                break;
+        }
+    }
+}
+
+static uint32_t runReaders(benchMode_t mode)
+{
+    uint32_t total = 0;
+    for(int i = 0; i < BENCH_READERS; i++)
+        readCount[i] = 0;
+    benchMode = mode;
+    os_timerDelay(BENCH_TIME);
+    benchMode = BENCH_IDLE;
+    /* Let the readers finish their last round */
+    os_timerDelay(20);
+    for(int i = 0; i < BENCH_READERS; i++)
+        total += readCount[i];
+    return total;
+}
+
+/*
+ * Uncontended cost of protecting a counter update, including the update and
+ * loop overhead. Subtract loopCycles to get the cost of the protection.
+ */
+static uint32_t counterCycles(benchMode_t mode)
+{
+    volatile uint32_t counter = 0;
+    uint32_t start = os_timerGetCycles();
+    for(int i = 0; i < CYCLE_RUNS; i++) {
+        switch(mode) {
+            case BENCH_CRITICAL:
+                os_criticalEnter();
+                counter++;
+                os_criticalExit();
+                break;
+            case BENCH_MUTEX:
+                os_mutexLock(tableMutex);
+                counter++;
+                os_mutexUnlock(tableMutex);
+                break;
+            default:
+                counter++;
+                break;
+        }
+    }
+    return (os_timerGetCycles() - start) / CYCLE_RUNS;
+}
+
+/*
+ * Uncontended latency of reading a snapshot of the table.
+ */
+static uint32_t snapshotCycles(benchMode_t mode)
+{
+    uint32_t copy[TABLE_SIZE];
+    uint32_t start = os_timerGetCycles();
+    for(int i = 0; i < CYCLE_RUNS; i++) {
+        if(mode == BENCH_SEQLOCK) {
+            os_seqlockRead(tableSeqlock, copy);
+        } else {
+            os_mutexLock(tableMutex);
+            memcpy(copy, table, sizeof(table));
+            os_mutexUnlock(tableMutex);
+        }
+    }
+    return (os_timerGetCycles() - start) / CYCLE_RUNS;
+}
+
+/*
+ * Uncontended post and wait on a counting semaphore by the same thread. An
+ * owner selects the direct-to-task backend.
+ */
+static uint32_t semCycles(os_threadHandle_t owner)
+{
+    uint32_t start;
+    uint32_t cycles;
+    os_semConfig_t conf = {
+        .maxCount = CYCLE_RUNS,
+        .owner = owner
+    };
+    os_semHandle_t sem = os_semNew(&conf);
+    APP_ERROR_CHECK_BOOL(sem != NULL);
+    start = os_timerGetCycles();
+    for(int i = 0; i < CYCLE_RUNS; i++) {
+        os_semPost(sem);
+        os_semWait(sem);
+    }
+    cycles = (os_timerGetCycles() - start) / CYCLE_RUNS;
+    os_semDelete(sem);
+    return cycles;
+}
+
+static void ringConsumer(void *args)
+{
+    const void *data;
+    uint32_t count;
+    while(1) {
+        (void)os_ringbufWait(ring, 10);
+        while((count = os_ringbufPeek(ring, &data)) != 0) {
+            os_ringbufRelease(ring, count);
+            ringConsumed += count;
+        }
+    }
+}
+
+/*
+ * Produce and consume in the same thread, so only the ring operations are
+ * measured. This uses its own ring, rcons is the consumer of the other one.
+ */
+static uint32_t ringCycles(uint32_t batch)
+{
+    uint32_t *data;
+    const void *out;
+    uint32_t count;
+    uint32_t start = os_timerGetCycles();
+    for(int i = 0; i < CYCLE_RUNS; i++) {
+        count = os_ringbufReserve(cycleRing, (void **)&data, batch);
+        for(uint32_t j = 0; j < count; j++)
+            data[j] = j;
+        os_ringbufCommit(cycleRing, count);
+        count = os_ringbufPeek(cycleRing, &out);
+        os_ringbufRelease(cycleRing, count);
+    }
+    return (os_timerGetCycles() - start) / (CYCLE_RUNS * batch);
+}
+
+/*
+ * Stream batches to the consumer thread at the same priority for BENCH_TIME.
+ */
+static uint32_t ringThroughput(void)
+{
+    uint32_t *data;
+    uint32_t count;
+    uint32_t start;
+    os_threadSetPriority(NULL, THREAD_PRIO_NORM);
+    ringConsumed = 0;
+    start = os_timerGetMs();
+    while(!os_timerIsElapsed(start, BENCH_TIME)) {
+        count = os_ringbufReserve(ring, (void **)&data, RING_BATCH);
+        if(!count) {
+            taskYIELD();
+            continue;
+        }
+        for(uint32_t j = 0; j < count; j++)
+            data[j] = j;
+        os_ringbufCommit(ring, count);
+    }
+    os_threadSetPriority(NULL, THREAD_PRIO_HIGH);
+    return ringConsumed * 1000 / BENCH_TIME;
+}
+
+static void benchThread(void *args)
+{
+    nrf_gpio_pin_clear(BSP_LED_0);
+    benchResults.mutexReads = runReaders(BENCH_MUTEX_READ);
+    benchResults.rwlockReads = runReaders(BENCH_RWLOCK_READ);
+    benchResults.loopCycles = counterCycles(BENCH_IDLE);
+    benchResults.criticalCycles = counterCycles(BENCH_CRITICAL);
+    benchResults.mutexCycles = counterCycles(BENCH_MUTEX);
+    benchResults.seqlockReadCycles = snapshotCycles(BENCH_SEQLOCK);
+    benchResults.mutexReadCycles = snapshotCycles(BENCH_MUTEX);
+    benchResults.semQueueCycles = semCycles(NULL);
+    benchResults.semDirectCycles = semCycles(os_threadSelf());
+    benchResults.ringSampleCycles = ringCycles(1);
+    benchResults.ringBatchCycles = ringCycles(RING_BATCH);
+    benchResults.ringSamplesPerSec = ringThroughput();
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_clear(BSP_LED_1);
+}
+
+void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
+{
+    app_error_handler(DEAD_BEEF, line_num, p_file_name);
+}
+
+int main(void)
+{
+    uint32_t errCode = 0;
+
+    errCode = nrf_drv_clock_init();
+    APP_ERROR_CHECK(errCode);
+    os_timerCycleInit();
+
+    nrf_gpio_cfg_output(BSP_LED_0);
+    nrf_gpio_cfg_output(BSP_LED_1);
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_set(BSP_LED_1);
+
+    for(int i = 0; i < TABLE_SIZE; i++)
+        table[i] = i;
+    tableMutex = os_mutexNew();
+    tableLock = os_rwlockNew();
+    tableSeqlock = os_seqlockNew(sizeof(table));
+    APP_ERROR_CHECK_BOOL(tableMutex && tableLock && tableSeqlock);
+    os_seqlockWrite(tableSeqlock, table);
+
+    os_threadConfig_t readerConfig = {
+        .name = "reader",
+        .threadCallback = readerThread,
+        .stackSize = BENCH_STACK_SIZE,
+        .priority = THREAD_PRIO_NORM
+    };
+    for(uint32_t i = 0; i < BENCH_READERS; i++) {
+        readerConfig.threadArgs = (void *)i;
+        APP_ERROR_CHECK_BOOL(os_threadNew(&readerConfig) != NULL);
+    }
+
+    os_threadConfig_t consumerConfig = {
+        .name = "rcons",
+        .threadCallback = ringConsumer,
+        .stackSize = BENCH_STACK_SIZE,
+        .priority = THREAD_PRIO_NORM
+    };
+    os_ringbufConfig_t ringConfig = {
+        .elemSize = sizeof(uint32_t),
+        .capacity = RING_CAPACITY,
+        .watermark = RING_CAPACITY / 2,
+        .consumer = os_threadNew(&consumerConfig)
+    };
+    APP_ERROR_CHECK_BOOL(ringConfig.consumer != NULL);
+    ring = os_ringbufNew(&ringConfig);
+    APP_ERROR_CHECK_BOOL(ring != NULL);
+    ringConfig.consumer = NULL;
+    cycleRing = os_ringbufNew(&ringConfig);
+    APP_ERROR_CHECK_BOOL(cycleRing != NULL);
+
+    os_threadConfig_t benchConfig = {
+        .name = "bench",
+        .threadCallback = benchThread,
+        .stackSize = BENCH_STACK_SIZE,
+        .priority = THREAD_PRIO_HIGH
+    };
+    APP_ERROR_CHECK_BOOL(os_threadNew(&benchConfig) != NULL);
+
+    os_startScheduler();
+    while (1);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Static thread creation test. Build with TEST=static.
+ * LED 1 is turned on when creating the threads did not take any heap memory,
+ * LED 2 and LED 3 blink from the static threads.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "bsp.h"
+#include "pca10040.h"
+#include "nrf52.h"
+#include "nordic_common.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_clock.h"
+#include "sdk_errors.h"
+#include "app_error.h"
+
+#include "os_thread.h"
+#include "os_timer.h"
+
+#define DEAD_BEEF 0xDEADBEEF
+#define TEST_STACK_SIZE     (configMINIMAL_STACK_SIZE + 100)
+
+static OS_THREAD_STACK_DEFINE(stack1, TEST_STACK_SIZE);
+static OS_THREAD_STACK_DEFINE(stack2, TEST_STACK_SIZE);
+static os_threadStorage_t storage1;
+static os_threadStorage_t storage2;
+
+static void blinkThread(void *args)
+{
+    uint32_t led = (uint32_t)args;
+    while(1) {
+        nrf_gpio_pin_toggle(led);
+        os_timerDelay(500);
+    }
+}
+
+void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
+{
+    app_error_handler(DEAD_BEEF, line_num, p_file_name);
+}
+
+int main(void)
+{
+    uint32_t errCode = 0;
+    size_t heapBefore;
+    os_threadHandle_t handle1;
+    os_threadHandle_t handle2;
+
+    errCode = nrf_drv_clock_init();
+    APP_ERROR_CHECK(errCode);
+
+    nrf_gpio_cfg_output(BSP_LED_0);
+    nrf_gpio_cfg_output(BSP_LED_1);
+    nrf_gpio_cfg_output(BSP_LED_2);
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_set(BSP_LED_1);
+    nrf_gpio_pin_set(BSP_LED_2);
+
+    os_threadConfig_t threadConfig1 = {
+        .name = "st1",
+        .threadCallback = blinkThread,
+        .threadArgs = (void *)BSP_LED_1,
+        .stackSize = TEST_STACK_SIZE,
+        .priority = THREAD_PRIO_NORM,
+        .stackBuffer = stack1,
+        .storage = &storage1
+    };
+
+    os_threadConfig_t threadConfig2 = {
+        .name = "st2",
+        .threadCallback = blinkThread,
+        .threadArgs = (void *)BSP_LED_2,
+        .stackSize = TEST_STACK_SIZE,
+        .priority = THREAD_PRIO_LOW,
+        .stackBuffer = stack2,
+        .storage = &storage2
+    };
+
+    os_threadConfig_t missingStack = threadConfig1;
+    missingStack.stackBuffer = NULL;
+
+    heapBefore = xPortGetFreeHeapSize();
+    handle1 = os_threadNewStatic(&threadConfig1);
+    handle2 = os_threadNew(&threadConfig2);
+    APP_ERROR_CHECK_BOOL(os_threadNewStatic(&missingStack) == NULL);
+    APP_ERROR_CHECK_BOOL(handle1 == &storage1.handle);
+    APP_ERROR_CHECK_BOOL(handle2 == &storage2.handle);
+    APP_ERROR_CHECK_BOOL(xPortGetFreeHeapSize() == heapBefore);
+    nrf_gpio_pin_clear(BSP_LED_0);
+
+    os_startScheduler();
+    while (1);
+    return 0;
+}
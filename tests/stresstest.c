@@ -0,0 +1,258 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Synchronisation stress test. Build with TEST=stress.
+ * LED 0 blinks while the test runs, LED 1 is turned on when all checks
+ * passed. A failed check ends in the app error handler.
+ * The tree has no host build, so this runs on the target instead of as the
+ * host stress tests the condition variable and ring buffer were specified
+ * with.
+ *
+ * FreeRTOS heap: eight threads of STRESS_STACK_SIZE take about 770 bytes
+ * each (640 bytes of stack, the task control block and two heap headers),
+ * about 6.2 KB. The idle and timer tasks and the timer queue add about
+ * 1.4 KB, the mutex one more queue. That does not fit in the default
+ * 4 KB heap, so the Makefile raises it to 12 KB for TEST=stress.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "bsp.h"
+#include "pca10040.h"
+#include "nrf52.h"
+#include "nordic_common.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_clock.h"
+#include "sdk_errors.h"
+#include "app_error.h"
+
+#include "os_thread.h"
+#include "os_timer.h"
+#include "os_mutex.h"
+#include "os_cond.h"
+#include "os_ringbuf.h"
+
+#define DEAD_BEEF 0xDEADBEEF
+#define STRESS_STACK_SIZE   (configMINIMAL_STACK_SIZE + 100)
+#define COND_PRODUCERS      2
+#define COND_CONSUMERS      3
+#define COND_ITEMS          5000
+#define COND_TIMEOUT        500
+#define RING_CAPACITY       64
+#define RING_WATERMARK      16
+#define RING_SAMPLES        20000
+
+static os_mutexHandle_t condMutex;
+static os_condHandle_t condVar;
+static volatile uint32_t condAvailable;
+static volatile uint32_t condConsumed;
+static volatile uint32_t condLostWakeups;
+static os_ringbufHandle_t ring;
+static volatile uint32_t ringReceived;
+static volatile uint32_t ringErrors;
+
+/*
+ * Producers hand out items one by one, every eighth item is announced with a
+ * broadcast instead of a signal. The delay pattern varies the interleaving.
+ */
+static void condProducer(void *args)
+{
+    uint32_t seed = (uint32_t)args;
+    for(uint32_t i = 0; i < COND_ITEMS; i++) {
+        os_mutexLock(condMutex);
+        condAvailable++;
+        if(i % 8)
+            os_condSignal(condVar);
+        else
+            os_condBroadcast(condVar);
+        os_mutexUnlock(condMutex);
+        seed = seed * 1103515245 + 12345;
+        if(seed & 0x10000)
+            taskYIELD();
+        else if(seed & 0x20000)
+            os_timerDelay(1);
+    }
+}
+
+/*
+ * Every item is signalled, so a consumer that times out while items are
+ * available missed its wake up.
+ */
+static void condConsumer(void *args)
+{
+    while(1) {
+        os_mutexLock(condMutex);
+        while(!condAvailable) {
+            if(!os_condTimedWait(condVar, condMutex, COND_TIMEOUT)
+                    && condAvailable)
+                condLostWakeups++;
+        }
+        condAvailable--;
+        condConsumed++;
+        os_mutexUnlock(condMutex);
+    }
+}
+
+/*
+ * Writes a running sequence number in batches of varying size. It runs at a
+ * higher priority than the consumer, like an ISR would.
+ */
+static void ringProducer(void *args)
+{
+    uint32_t seed = 1;
+    uint32_t sequence = 0;
+    uint32_t *data;
+    uint32_t count;
+    uint32_t written;
+    while(sequence < RING_SAMPLES) {
+        seed = seed * 1103515245 + 12345;
+        count = os_ringbufReserve(ring, (void **)&data, (seed >> 16) % 8 + 1);
+        if(!count) {
+            os_timerDelay(1);
+            continue;
+        }
+        for(written = 0; written < count && sequence < RING_SAMPLES; written++)
+            data[written] = sequence++;
+        os_ringbufCommit(ring, written);
+        if(seed & 0x100000)
+            os_timerDelay(1);
+    }
+}
+
+/*
+ * Checks that every sample arrives once and in order. The last samples may
+ * stay below the watermark, so the consumer also drains on a timeout.
+ */
+static void ringConsumer(void *args)
+{
+    uint32_t expected = 0;
+    const uint32_t *data;
+    uint32_t count;
+    while(1) {
+        (void)os_ringbufWait(ring, 50);
+        while((count = os_ringbufPeek(ring, (const void **)&data)) != 0) {
+            for(uint32_t i = 0; i < count; i++) {
+                if(data[i] != expected)
+                    ringErrors++;
+                expected = data[i] + 1;
+            }
+            os_ringbufRelease(ring, count);
+            ringReceived += count;
+        }
+    }
+}
+
+static void stressThread(void *args)
+{
+    uint32_t start = os_timerGetMs();
+    while(condConsumed < COND_PRODUCERS * COND_ITEMS
+            || ringReceived < RING_SAMPLES) {
+        APP_ERROR_CHECK_BOOL(!os_timerIsElapsed(start, 60000));
+        nrf_gpio_pin_toggle(BSP_LED_0);
+        os_timerDelay(100);
+    }
+    APP_ERROR_CHECK_BOOL(condLostWakeups == 0);
+    APP_ERROR_CHECK_BOOL(condAvailable == 0);
+    APP_ERROR_CHECK_BOOL(ringErrors == 0);
+    APP_ERROR_CHECK_BOOL(ringReceived == RING_SAMPLES);
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_clear(BSP_LED_1);
+}
+
+void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
+{
+    app_error_handler(DEAD_BEEF, line_num, p_file_name);
+}
+
+int main(void)
+{
+    uint32_t errCode = 0;
+
+    errCode = nrf_drv_clock_init();
+    APP_ERROR_CHECK(errCode);
+
+    nrf_gpio_cfg_output(BSP_LED_0);
+    nrf_gpio_cfg_output(BSP_LED_1);
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_set(BSP_LED_1);
+
+    condMutex = os_mutexNew();
+    condVar = os_condNew();
+    APP_ERROR_CHECK_BOOL(condMutex && condVar);
+
+    os_threadConfig_t producerConfig = {
+        .name = "prod",
+        .threadCallback = condProducer,
+        .stackSize = STRESS_STACK_SIZE,
+        .priority = THREAD_PRIO_NORM
+    };
+    for(uint32_t i = 0; i < COND_PRODUCERS; i++) {
+        producerConfig.threadArgs = (void *)(i + 1);
+        producerConfig.priority = i ? THREAD_PRIO_BELOW_NORM : THREAD_PRIO_NORM;
+        APP_ERROR_CHECK_BOOL(os_threadNew(&producerConfig) != NULL);
+    }
+
+    os_threadConfig_t consumerConfig = {
+        .name = "cons",
+        .threadCallback = condConsumer,
+        .stackSize = STRESS_STACK_SIZE,
+        .priority = THREAD_PRIO_NORM
+    };
+    for(uint32_t i = 0; i < COND_CONSUMERS; i++) {
+        consumerConfig.priority = i ? THREAD_PRIO_NORM : THREAD_PRIO_ABOVE_NORM;
+        APP_ERROR_CHECK_BOOL(os_threadNew(&consumerConfig) != NULL);
+    }
+
+    os_threadConfig_t ringConsumerConfig = {
+        .name = "rcons",
+        .threadCallback = ringConsumer,
+        .stackSize = STRESS_STACK_SIZE,
+        .priority = THREAD_PRIO_BELOW_NORM
+    };
+    os_ringbufConfig_t ringConfig = {
+        .elemSize = sizeof(uint32_t),
+        .capacity = RING_CAPACITY,
+        .watermark = RING_WATERMARK,
+        .consumer = os_threadNew(&ringConsumerConfig)
+    };
+    APP_ERROR_CHECK_BOOL(ringConfig.consumer != NULL);
+    ring = os_ringbufNew(&ringConfig);
+    APP_ERROR_CHECK_BOOL(ring != NULL);
+
+    os_threadConfig_t ringProducerConfig = {
+        .name = "rprod",
+        .threadCallback = ringProducer,
+        .stackSize = STRESS_STACK_SIZE,
+        .priority = THREAD_PRIO_ABOVE_NORM
+    };
+    APP_ERROR_CHECK_BOOL(os_threadNew(&ringProducerConfig) != NULL);
+
+    os_threadConfig_t stressConfig = {
+        .name = "stress",
+        .threadCallback = stressThread,
+        .stackSize = STRESS_STACK_SIZE,
+        .priority = THREAD_PRIO_HIGH
+    };
+    APP_ERROR_CHECK_BOOL(os_threadNew(&stressConfig) != NULL);
+
+    os_startScheduler();
+    while (1);
+    return 0;
+}
@@ -30,6 +30,7 @@
 #include "app_error.h"
 #include "nrf_drv_clock.h"
 
+#include "os_future.h"
 #include "os_mutex.h"
 #include "os_thread.h"
 #include "os_timer.h"
@@ -59,11 +60,7 @@ os_mutexHandle_t mutex;
 
 static void testThread2(void *args)
 {
-    while(1) {
-        nrf_gpio_pin_toggle(LED_2);
-        os_timerDelay(750);
-    }
-    os_threadExit(threadHandle2);
+    nrf_gpio_pin_toggle(LED_2);
 }
 
 void testThread3(void *args)
@@ -76,7 +73,7 @@ void testThread3(void *args)
             os_timerDelay(200);
         }
     }
-    os_threadExit(threadHandle3);
+    os_threadExit();
 }
 
 void testThread4(void *args)
@@ -89,7 +86,75 @@ void testThread4(void *args)
             os_timerDelay(200);
         }
     }
-    os_threadExit(threadHandle4);
+    os_threadExit();
+}
+
+static void idleThread(void *args)
+{
+    while(1)
+        os_threadWait();
+}
+
+/*
+ * Calls on a stopped thread must fail instead of acting on the caller. If
+ * os_threadPause acted on the caller, LED 1 would never turn on.
+ */
+static void stoppedThreadTest(void *args)
+{
+    os_threadConfig_t victimConfig = {
+        .name = "victim",
+        .threadCallback = idleThread,
+        .stackSize = configMINIMAL_STACK_SIZE + 100,
+        .priority = THREAD_PRIO_LOW
+    };
+    os_threadHandle_t victim = os_threadNew(&victimConfig);
+    APP_ERROR_CHECK_BOOL(victim != NULL);
+    APP_ERROR_CHECK_BOOL(os_threadStop(victim));
+    APP_ERROR_CHECK_BOOL(!os_threadPause(victim));
+    APP_ERROR_CHECK_BOOL(!os_threadResume(victim));
+    os_threadNotify(victim);
+    APP_ERROR_CHECK_BOOL(!os_threadNotifyValue(victim, 1,
+            THREAD_NOTIFY_SET_BITS));
+    os_threadSetPriority(victim, THREAD_PRIO_HIGH);
+    APP_ERROR_CHECK_BOOL(os_threadGetPriority(NULL) == THREAD_PRIO_HIGH);
+    APP_ERROR_CHECK_BOOL(!os_threadIsRunning(victim));
+    APP_ERROR_CHECK_BOOL(os_threadJoin(victim, 0));
+    nrf_gpio_pin_clear(LED_1);
+}
+
+static os_future_t reply = OS_FUTURE_INIT;
+
+static void replyThread(void *args)
+{
+    os_threadHandle_t waiter = args;
+    os_timerDelay(20);
+    APP_ERROR_CHECK_BOOL(os_threadNotifyValue(waiter, 0x1,
+            THREAD_NOTIFY_SET_BITS));
+    os_timerDelay(20);
+    APP_ERROR_CHECK_BOOL(os_futureSet(&reply, 42));
+}
+
+/*
+ * A mailbox value sent while a thread waits for a future must neither wake
+ * os_futureGet early nor get lost.
+ */
+static void futureThreadTest(void *args)
+{
+    uint32_t value = 0;
+    os_threadConfig_t replyConfig = {
+        .name = "reply",
+        .threadCallback = replyThread,
+        .threadArgs = os_threadSelf(),
+        .stackSize = configMINIMAL_STACK_SIZE + 100,
+        .priority = THREAD_PRIO_HIGH
+    };
+    os_threadHandle_t replier = os_threadNew(&replyConfig);
+    APP_ERROR_CHECK_BOOL(replier != NULL);
+    APP_ERROR_CHECK_BOOL(os_futureGet(&reply, &value, 500));
+    APP_ERROR_CHECK_BOOL(value == 42);
+    APP_ERROR_CHECK_BOOL(os_threadWaitValue(0, UINT32_MAX, &value, 0));
+    APP_ERROR_CHECK_BOOL(value == 0x1);
+    APP_ERROR_CHECK_BOOL(os_threadJoin(replier, 100));
 }
 
 static void timerTask(void *args)
@@ -131,7 +196,8 @@ int main(void)
         .threadCallback = testThread2,
         .threadArgs = NULL,
         .stackSize = configMINIMAL_STACK_SIZE + 100,
-        .priority = THREAD_PRIO_NORM
+        .priority = THREAD_PRIO_NORM,
+        .period = 750
     };
 
     os_threadConfig_t threadConfig3 = {
@@ -150,6 +216,22 @@ int main(void)
         .priority = THREAD_PRIO_LOW
     };
 
+    os_threadConfig_t stoppedConfig = {
+        .name = "stopped",
+        .threadCallback = stoppedThreadTest,
+        .threadArgs = NULL,
+        .stackSize = configMINIMAL_STACK_SIZE + 100,
+        .priority = THREAD_PRIO_HIGH
+    };
+
+    os_threadConfig_t futureConfig = {
+        .name = "future",
+        .threadCallback = futureThreadTest,
+        .threadArgs = NULL,
+        .stackSize = configMINIMAL_STACK_SIZE + 100,
+        .priority = THREAD_PRIO_NORM
+    };
+
     os_timerConfig_t timerConf = {
             .name = "task1",
             .period = 1000,
@@ -163,6 +245,8 @@ int main(void)
     threadHandle2 = os_threadNew(&threadConfig2);
     threadHandle3 = os_threadNew(&threadConfig3);
     threadHandle4 = os_threadNew(&threadConfig4);
+    APP_ERROR_CHECK_BOOL(os_threadNew(&stoppedConfig) != NULL);
+    APP_ERROR_CHECK_BOOL(os_threadNew(&futureConfig) != NULL);
     os_startScheduler();
     while (1);
     return 0;
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2016 Bart Monhemius.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Work queue test. Build with TEST=workqueue.
+ * LED 0 blinks while the test runs, LED 1 is turned on when all checks
+ * passed. A failed check ends in the app error handler.
+ *
+ * FreeRTOS heap: four threads of WQ_STACK_SIZE take about 770 bytes each,
+ * about 3.1 KB. The idle and timer tasks and the timer queue add about
+ * 1.4 KB and the two job queues about 0.5 KB. That does not fit in the
+ * default 4 KB heap, so the Makefile raises it to 12 KB for TEST=workqueue.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "bsp.h"
+#include "pca10040.h"
+#include "nrf52.h"
+#include "nordic_common.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_clock.h"
+#include "sdk_errors.h"
+#include "app_error.h"
+
+#include "os_thread.h"
+#include "os_timer.h"
+#include "os_workqueue.h"
+
+#define DEAD_BEEF 0xDEADBEEF
+#define WQ_STACK_SIZE       (configMINIMAL_STACK_SIZE + 100)
+#define THREAD_JOBS         200
+#define ISR_JOBS            200
+#define JOB_COUNT           (THREAD_JOBS + ISR_JOBS)
+#define FILL_LENGTH         8
+#define FILL_EXTRA          5
+#define ISR_PERIOD_US       500
+
+static os_workqueueHandle_t jobQueue;
+static volatile uint8_t jobRuns[JOB_COUNT];
+static volatile uint32_t isrJobs;
+static volatile uint32_t fillRuns;
+
+static void countJob(void *args)
+{
+    jobRuns[(uint32_t)args]++;
+}
+
+static void fillJob(void *args)
+{
+    fillRuns++;
+}
+
+/* Submits one job per compare event until ISR_JOBS are submitted */
+void TIMER1_IRQHandler(void)
+{
+    if(!NRF_TIMER1->EVENTS_COMPARE[0])
+        return;
+    NRF_TIMER1->EVENTS_COMPARE[0] = 0;
+    (void)NRF_TIMER1->EVENTS_COMPARE[0];
+    if(os_workIsrSubmit(jobQueue, countJob,
+            (void *)(THREAD_JOBS + isrJobs)))
+        isrJobs++;
+    if(isrJobs == ISR_JOBS)
+        NRF_TIMER1->TASKS_STOP = 1;
+}
+
+static void isrTimerStart(void)
+{
+    NRF_TIMER1->MODE = TIMER_MODE_MODE_Timer;
+    NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    NRF_TIMER1->PRESCALER = 4;  /* 1 MHz */
+    NRF_TIMER1->CC[0] = ISR_PERIOD_US;
+    NRF_TIMER1->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+    NRF_TIMER1->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+    NVIC_SetPriority(TIMER1_IRQn, configLIBRARY_LOWEST_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(TIMER1_IRQn);
+    NRF_TIMER1->TASKS_START = 1;
+}
+
+static void waitCompleted(os_workqueueHandle_t handle, uint32_t count)
+{
+    os_workqueueStats_t stats;
+    uint32_t start = os_timerGetMs();
+    do {
+        APP_ERROR_CHECK_BOOL(!os_timerIsElapsed(start, 10000));
+        nrf_gpio_pin_toggle(BSP_LED_0);
+        os_timerDelay(50);
+        os_workqueueGetStats(handle, &stats);
+    } while(stats.completed < count);
+}
+
+/*
+ * A worker that can not be created must leave nothing behind. Each stack
+ * takes 40% of the free heap, so the first worker starts and the third one
+ * fails at the latest.
+ */
+static void unwindTest(void)
+{
+    size_t freeHeap = xPortGetFreeHeapSize();
+    os_workqueueConfig_t conf = {
+        .name = "big",
+        .workerCount = 3,
+        .stackSize = freeHeap * 2 / 5 / sizeof(StackType_t),
+        .priority = THREAD_PRIO_LOW,
+        .queueLength = 1
+    };
+    APP_ERROR_CHECK_BOOL(os_workqueueNew(&conf) == NULL);
+    APP_ERROR_CHECK_BOOL(xPortGetFreeHeapSize() == freeHeap);
+}
+
+/*
+ * Jobs submitted from a thread and from the timer ISR must each run exactly
+ * once. The submitter waits a tick between jobs, so none are dropped.
+ */
+static void submitTest(void)
+{
+    os_workqueueStats_t stats;
+    os_workqueueConfig_t conf = {
+        .name = "job",
+        .workerCount = 2,
+        .stackSize = WQ_STACK_SIZE,
+        .priority = THREAD_PRIO_NORM,
+        .queueLength = FILL_LENGTH
+    };
+    jobQueue = os_workqueueNew(&conf);
+    APP_ERROR_CHECK_BOOL(jobQueue != NULL);
+
+    isrTimerStart();
+    for(uint32_t i = 0; i < THREAD_JOBS; i++) {
+        APP_ERROR_CHECK_BOOL(os_workSubmit(jobQueue, countJob, (void *)i));
+        os_timerDelay(1);
+    }
+    waitCompleted(jobQueue, JOB_COUNT);
+
+    for(uint32_t i = 0; i < JOB_COUNT; i++)
+        APP_ERROR_CHECK_BOOL(jobRuns[i] == 1);
+    os_workqueueGetStats(jobQueue, &stats);
+    APP_ERROR_CHECK_BOOL(stats.submitted == JOB_COUNT);
+    APP_ERROR_CHECK_BOOL(stats.completed == JOB_COUNT);
+    APP_ERROR_CHECK_BOOL(stats.dropped == 0);
+    APP_ERROR_CHECK_BOOL(stats.depth == 0);
+}
+
+/*
+ * The worker runs below the test thread, so it can not drain the queue
+ * while the test thread submits. Everything above FILL_LENGTH is dropped.
+ */
+static void overfillTest(void)
+{
+    os_workqueueStats_t stats;
+    os_workqueueConfig_t conf = {
+        .name = "fill",
+        .workerCount = 1,
+        .stackSize = WQ_STACK_SIZE,
+        .priority = THREAD_PRIO_LOW,
+        .queueLength = FILL_LENGTH
+    };
+    os_workqueueHandle_t fillQueue = os_workqueueNew(&conf);
+    APP_ERROR_CHECK_BOOL(fillQueue != NULL);
+
+    for(uint32_t i = 0; i < FILL_LENGTH + FILL_EXTRA; i++)
+        APP_ERROR_CHECK_BOOL(os_workSubmit(fillQueue, fillJob, NULL)
+                == (i < FILL_LENGTH));
+    os_workqueueGetStats(fillQueue, &stats);
+    APP_ERROR_CHECK_BOOL(stats.submitted == FILL_LENGTH);
+    APP_ERROR_CHECK_BOOL(stats.dropped == FILL_EXTRA);
+    APP_ERROR_CHECK_BOOL(stats.depth == FILL_LENGTH);
+    APP_ERROR_CHECK_BOOL(stats.maxDepth == FILL_LENGTH);
+    APP_ERROR_CHECK_BOOL(stats.completed == 0);
+
+    waitCompleted(fillQueue, FILL_LENGTH);
+    os_workqueueGetStats(fillQueue, &stats);
+    APP_ERROR_CHECK_BOOL(fillRuns == FILL_LENGTH);
+    APP_ERROR_CHECK_BOOL(stats.depth == 0);
+}
+
+static void testThread(void *args)
+{
+    unwindTest();
+    submitTest();
+    overfillTest();
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_clear(BSP_LED_1);
+}
+
+void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
+{
+    app_error_handler(DEAD_BEEF, line_num, p_file_name);
+}
+
+int main(void)
+{
+    uint32_t errCode = 0;
+
+    errCode = nrf_drv_clock_init();
+    APP_ERROR_CHECK(errCode);
+
+    nrf_gpio_cfg_output(BSP_LED_0);
+    nrf_gpio_cfg_output(BSP_LED_1);
+    nrf_gpio_pin_set(BSP_LED_0);
+    nrf_gpio_pin_set(BSP_LED_1);
+
+    os_threadConfig_t testConfig = {
+        .name = "wqt",
+        .threadCallback = testThread,
+        .stackSize = WQ_STACK_SIZE,
+        .priority = THREAD_PRIO_HIGH
+    };
+    APP_ERROR_CHECK_BOOL(os_threadNew(&testConfig) != NULL);
+
+    os_startScheduler();
+    while (1);
+    return 0;
+}